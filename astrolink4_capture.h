@@ -0,0 +1,193 @@
+/*******************************************************************************
+ Copyright(c) 2024 astrojolo.com
+ .
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#ifndef ASTROLINK4_CAPTURE_H
+#define ASTROLINK4_CAPTURE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <cstring>
+#include <chrono>
+#include <string>
+
+/**************************************************************************************
+** Serial capture file format, shared by the driver (recording) and astrolink4_replay
+** (playback). All fields are stored in host byte order.
+**
+**   CaptureFileHeader
+**   { CaptureRecordHeader, payload[length] } ...
+**
+** Payload is the command or reply line without the trailing newline. Timestamps are
+** microseconds of the monotonic clock counted from the moment the capture started.
+***************************************************************************************/
+
+#define CAPTURE_MAGIC "AL4CAP"
+#define CAPTURE_VERSION 1
+
+enum CaptureRecordKind
+{
+    CAPTURE_COMMAND = 0,
+    CAPTURE_REPLY = 1,
+    CAPTURE_TIMEOUT = 2,
+    CAPTURE_ERROR = 3
+};
+
+#pragma pack(push, 1)
+struct CaptureFileHeader
+{
+    char magic[6];
+    uint16_t version;
+    uint64_t startTime;         // wall clock at capture start [us since epoch]
+};
+
+struct CaptureRecordHeader
+{
+    uint64_t timestamp;         // monotonic [us since capture start]
+    uint8_t kind;
+    uint8_t reserved;
+    uint16_t length;
+};
+#pragma pack(pop)
+
+struct CaptureRecord
+{
+    uint64_t timestamp { 0 };
+    uint8_t kind { CAPTURE_COMMAND };
+    std::string data;
+};
+
+class CaptureWriter
+{
+    public:
+        ~CaptureWriter()
+        {
+            close();
+        }
+
+        bool open(const char *path)
+        {
+            close();
+            file = fopen(path, "wb");
+            if (!file)
+                return false;
+
+            CaptureFileHeader header;
+            memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+            header.version = CAPTURE_VERSION;
+            header.startTime = std::chrono::duration_cast<std::chrono::microseconds>(
+                                   std::chrono::system_clock::now().time_since_epoch()).count();
+            start = std::chrono::steady_clock::now();
+            if (fwrite(&header, sizeof(header), 1, file) != 1)
+            {
+                close();
+                return false;
+            }
+            return true;
+        }
+
+        void close()
+        {
+            if (file)
+                fclose(file);
+            file = nullptr;
+        }
+
+        bool isOpen() const
+        {
+            return file != nullptr;
+        }
+
+        void write(CaptureRecordKind kind, const char *data, size_t length)
+        {
+            if (!file)
+                return;
+
+            CaptureRecordHeader header;
+            header.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+                                   std::chrono::steady_clock::now() - start).count();
+            header.kind = kind;
+            header.reserved = 0;
+            header.length = static_cast<uint16_t>(length);
+            fwrite(&header, sizeof(header), 1, file);
+            if (length > 0)
+                fwrite(data, 1, length, file);
+            // a command is always followed by its outcome, flushing once per exchange is enough
+            if (kind != CAPTURE_COMMAND)
+                fflush(file);
+        }
+
+    private:
+        FILE *file { nullptr };
+        std::chrono::steady_clock::time_point start;
+};
+
+class CaptureReader
+{
+    public:
+        ~CaptureReader()
+        {
+            close();
+        }
+
+        bool open(const char *path)
+        {
+            close();
+            file = fopen(path, "rb");
+            if (!file)
+                return false;
+            if (fread(&header, sizeof(header), 1, file) != 1 ||
+                    memcmp(header.magic, CAPTURE_MAGIC, sizeof(header.magic)) != 0 ||
+                    header.version != CAPTURE_VERSION)
+            {
+                close();
+                return false;
+            }
+            return true;
+        }
+
+        void close()
+        {
+            if (file)
+                fclose(file);
+            file = nullptr;
+        }
+
+        bool next(CaptureRecord &record)
+        {
+            CaptureRecordHeader recordHeader;
+            if (!file || fread(&recordHeader, sizeof(recordHeader), 1, file) != 1)
+                return false;
+            record.timestamp = recordHeader.timestamp;
+            record.kind = recordHeader.kind;
+            record.data.resize(recordHeader.length);
+            if (recordHeader.length > 0 && fread(&record.data[0], 1, recordHeader.length, file) != recordHeader.length)
+                return false;
+            return true;
+        }
+
+        const CaptureFileHeader &fileHeader() const
+        {
+            return header;
+        }
+
+    private:
+        FILE *file { nullptr };
+        CaptureFileHeader header {};
+};
+
+#endif
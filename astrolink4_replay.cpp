@@ -0,0 +1,215 @@
+/*******************************************************************************
+ Copyright(c) 2024 astrojolo.com
+ .
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+/**************************************************************************************
+** Replays a serial capture recorded by the driver as a virtual AstroLink 4 micro.
+** A pseudo terminal is created and its path printed, the driver is then connected
+** to that port. Every received command is matched against the recording in order
+** and answered with the recorded reply, either with the recorded latency or at once.
+** Recorded timeouts are reproduced by not answering.
+***************************************************************************************/
+
+#include "astrolink4_capture.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <poll.h>
+#include <thread>
+#include <vector>
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-f] [-l] [-p link] capture_file\n", name);
+    fprintf(stderr, "  -f       reply as fast as possible instead of with the recorded latency\n");
+    fprintf(stderr, "  -l       loop the recording instead of exiting at its end\n");
+    fprintf(stderr, "  -p link  create a symlink to the virtual port\n");
+}
+
+struct Exchange
+{
+    std::string command;
+    CaptureRecord outcome;
+    uint64_t latency { 0 };
+};
+
+// find next exchange for the command, exact match first, then the same command letter
+static int findExchange(const std::vector<Exchange> &exchanges, size_t from, const std::string &command)
+{
+    for (size_t i = from; i < exchanges.size(); i++)
+        if (exchanges[i].command == command)
+            return i;
+    for (size_t i = from; i < exchanges.size(); i++)
+        if (!exchanges[i].command.empty() && !command.empty() && exchanges[i].command[0] == command[0])
+            return i;
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    bool fast = false, loop = false;
+    const char *link = nullptr;
+    int opt;
+    while ((opt = getopt(argc, argv, "flp:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'f':
+                fast = true;
+                break;
+            case 'l':
+                loop = true;
+                break;
+            case 'p':
+                link = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    CaptureReader reader;
+    if (!reader.open(argv[optind]))
+    {
+        fprintf(stderr, "Cannot read capture file %s\n", argv[optind]);
+        return 1;
+    }
+
+    std::vector<Exchange> exchanges;
+    CaptureRecord record;
+    while (reader.next(record))
+    {
+        if (record.kind == CAPTURE_COMMAND)
+        {
+            Exchange exchange;
+            exchange.command = record.data;
+            exchange.outcome.timestamp = record.timestamp;
+            exchange.outcome.kind = CAPTURE_TIMEOUT;
+            exchanges.push_back(exchange);
+        }
+        else if (!exchanges.empty())
+        {
+            Exchange &exchange = exchanges.back();
+            exchange.latency = record.timestamp - exchange.outcome.timestamp;
+            exchange.outcome = record;
+        }
+    }
+    if (exchanges.empty())
+    {
+        fprintf(stderr, "Capture file contains no commands\n");
+        return 1;
+    }
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+    {
+        perror("posix_openpt");
+        return 1;
+    }
+    const char *slaveName = ptsname(master);
+
+    // keep the slave side open so the master does not see a hangup between driver connections
+    int slave = open(slaveName, O_RDWR | O_NOCTTY);
+    struct termios tio;
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+
+    if (link)
+    {
+        unlink(link);
+        if (symlink(slaveName, link) != 0)
+            perror("symlink");
+    }
+    printf("AstroLink 4 micro replay of %zu exchanges on %s\n", exchanges.size(), link ? link : slaveName);
+    fflush(stdout);
+
+    size_t cursor = 0, replayed = 0, mismatched = 0;
+    std::string line;
+    char buf[256];
+    bool running = true;
+    while (running)
+    {
+        struct pollfd pfd = { master, POLLIN, 0 };
+        if (poll(&pfd, 1, 1000) <= 0)
+            continue;
+        ssize_t n = read(master, buf, sizeof(buf));
+        if (n <= 0)
+            break;
+
+        for (ssize_t i = 0; i < n && running; i++)
+        {
+            if (buf[i] == '\r')
+                continue;
+            if (buf[i] != '\n')
+            {
+                line += buf[i];
+                continue;
+            }
+
+            int index = findExchange(exchanges, cursor, line);
+            if (index < 0 && loop)
+                index = findExchange(exchanges, 0, line);
+            if (index < 0)
+            {
+                fprintf(stderr, "No recorded reply for '%s'\n", line.c_str());
+                mismatched++;
+                line.clear();
+                continue;
+            }
+            if (exchanges[index].command != line)
+                mismatched++;
+
+            const Exchange &exchange = exchanges[index];
+            if (exchange.outcome.kind == CAPTURE_REPLY)
+            {
+                if (!fast)
+                    std::this_thread::sleep_for(std::chrono::microseconds(exchange.latency));
+                std::string reply = exchange.outcome.data + "\n";
+                if (write(master, reply.c_str(), reply.size()) < 0)
+                    perror("write");
+            }
+            replayed++;
+            line.clear();
+
+            cursor = index + 1;
+            if (cursor >= exchanges.size())
+            {
+                if (loop)
+                    cursor = 0;
+                else
+                    running = false;
+            }
+        }
+    }
+
+    printf("Replayed %zu exchanges, %zu did not match the recording\n", replayed, mismatched);
+    if (link)
+        unlink(link);
+    close(slave);
+    close(master);
+    return 0;
+}
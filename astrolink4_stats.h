@@ -0,0 +1,442 @@
+/*******************************************************************************
+ Copyright(c) 2024 astrojolo.com
+ .
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#ifndef ASTROLINK4_STATS_H
+#define ASTROLINK4_STATS_H
+
+#include <cmath>
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+/**************************************************************************************
+** Rolling window statistics over a time window. Every sample updates running sums,
+** so mean, variance and least squares trend cost O(1) per sample and min/max are kept
+** in monotonic queues (amortized O(1)). Values and times are stored relative to the
+** first sample after reset to keep the running sums well conditioned.
+***************************************************************************************/
+class RollingStats
+{
+    public:
+        explicit RollingStats(double window = 600) : windowLength(window) {}
+
+        void setWindow(double window)
+        {
+            windowLength = window;
+            reset();
+        }
+
+        double window() const
+        {
+            return windowLength;
+        }
+
+        void reset()
+        {
+            samples.clear();
+            minQueue.clear();
+            maxQueue.clear();
+            sumY = sumYY = sumT = sumTT = sumTY = 0;
+        }
+
+        // time in seconds, trend is returned in value units per second
+        void add(double time, double value)
+        {
+            if (samples.empty())
+            {
+                timeOrigin = time;
+                valueOrigin = value;
+            }
+            double t = time - timeOrigin, y = value - valueOrigin;
+
+            while (!samples.empty() && samples.front().t < t - windowLength)
+                evict();
+
+            samples.push_back({t, y});
+            sumY += y;
+            sumYY += y * y;
+            sumT += t;
+            sumTT += t * t;
+            sumTY += t * y;
+
+            while (!minQueue.empty() && minQueue.back().y >= y)
+                minQueue.pop_back();
+            minQueue.push_back({t, y});
+            while (!maxQueue.empty() && maxQueue.back().y <= y)
+                maxQueue.pop_back();
+            maxQueue.push_back({t, y});
+        }
+
+        size_t count() const
+        {
+            return samples.size();
+        }
+
+        double last() const
+        {
+            return samples.empty() ? 0 : samples.back().y + valueOrigin;
+        }
+
+        double mean() const
+        {
+            return samples.empty() ? 0 : sumY / samples.size() + valueOrigin;
+        }
+
+        double variance() const
+        {
+            size_t n = samples.size();
+            if (n < 2)
+                return 0;
+            double var = (sumYY - sumY * sumY / n) / (n - 1);
+            return var > 0 ? var : 0;
+        }
+
+        double stddev() const
+        {
+            return std::sqrt(variance());
+        }
+
+        double trend() const
+        {
+            size_t n = samples.size();
+            if (n < 2)
+                return 0;
+            double denominator = n * sumTT - sumT * sumT;
+            if (denominator <= 0)
+                return 0;
+            return (n * sumTY - sumT * sumY) / denominator;
+        }
+
+        double min() const
+        {
+            return minQueue.empty() ? 0 : minQueue.front().y + valueOrigin;
+        }
+
+        double max() const
+        {
+            return maxQueue.empty() ? 0 : maxQueue.front().y + valueOrigin;
+        }
+
+    private:
+        struct Sample
+        {
+            double t, y;
+        };
+
+        void evict()
+        {
+            const Sample &s = samples.front();
+            sumY -= s.y;
+            sumYY -= s.y * s.y;
+            sumT -= s.t;
+            sumTT -= s.t * s.t;
+            sumTY -= s.t * s.y;
+            if (!minQueue.empty() && minQueue.front().t <= s.t)
+                minQueue.pop_front();
+            if (!maxQueue.empty() && maxQueue.front().t <= s.t)
+                maxQueue.pop_front();
+            samples.pop_front();
+        }
+
+        double windowLength;
+        double timeOrigin { 0 }, valueOrigin { 0 };
+        std::deque<Sample> samples, minQueue, maxQueue;
+        double sumY { 0 }, sumYY { 0 }, sumT { 0 }, sumTT { 0 }, sumTY { 0 };
+};
+
+/**************************************************************************************
+** Adaptive averaging of a noisy, slowly drifting reading. Per sample noise is estimated
+** from successive differences, so a slow drift does not inflate it, and the averaging
+** window is sized to reach the target uncertainty of the mean. A step larger than
+** STEP_SIGMAS restarts the window so real changes are not smeared out. Means over the
+** last n samples come from a ring of cumulative sums, O(1) per sample.
+***************************************************************************************/
+class AdaptiveAverager
+{
+    public:
+        explicit AdaptiveAverager(double target = 0.01, size_t maxSamples = 240)
+        {
+            configure(target, maxSamples);
+        }
+
+        void configure(double target, size_t maxSamples)
+        {
+            targetUncertainty = target;
+            cumulative.assign(maxSamples + 1, 0);
+            reset();
+        }
+
+        void reset()
+        {
+            total = start = 0;
+            noiseVariance = 0;
+        }
+
+        void add(double value)
+        {
+            if (total == 0)
+                origin = value;
+            double y = value - origin;
+            if (total > start)
+            {
+                double diff = y - previous;
+                // a real change of the sky restarts the window and is kept out of the noise estimate
+                if (noiseVariance > 0 && std::fabs(y - (mean() - origin)) > STEP_SIGMAS * std::sqrt(noiseVariance) + targetUncertainty)
+                    start = total;
+                else if (noiseVariance == 0)
+                    noiseVariance = diff * diff / 2.0;
+                else
+                    noiseVariance = (1.0 - NOISE_ALPHA) * noiseVariance + NOISE_ALPHA * diff * diff / 2.0;
+            }
+            previous = y;
+            cumulative[(total + 1) % cumulative.size()] = cumulative[total % cumulative.size()] + y;
+            total++;
+        }
+
+        size_t samples() const
+        {
+            size_t available = total - start;
+            if (available > cumulative.size() - 1)
+                available = cumulative.size() - 1;
+            size_t needed = (targetUncertainty > 0) ? static_cast<size_t>(std::ceil(noiseVariance / (targetUncertainty * targetUncertainty))) : available;
+            if (needed < 1)
+                needed = 1;
+            return needed < available ? needed : available;
+        }
+
+        double mean() const
+        {
+            size_t n = samples();
+            if (n == 0)
+                return 0;
+            double sum = cumulative[total % cumulative.size()] - cumulative[(total - n) % cumulative.size()];
+            return sum / n + origin;
+        }
+
+        double uncertainty() const
+        {
+            size_t n = samples();
+            return (n > 0) ? std::sqrt(noiseVariance / n) : 0;
+        }
+
+        double noise() const
+        {
+            return std::sqrt(noiseVariance);
+        }
+
+    private:
+        static constexpr double NOISE_ALPHA { 0.05 };
+        static constexpr double STEP_SIGMAS { 5.0 };
+
+        std::vector<double> cumulative;
+        size_t total { 0 }, start { 0 };
+        double targetUncertainty { 0.01 };
+        double noiseVariance { 0 }, origin { 0 }, previous { 0 };
+};
+
+/**************************************************************************************
+** Retransmission timeout estimator in the style of TCP (RFC 6298): smoothed round trip
+** time plus four times its mean deviation, clamped to [floor, ceiling]. Until the first
+** sample arrives the ceiling is used. A timeout doubles the current value.
+***************************************************************************************/
+class RttEstimator
+{
+    public:
+        RttEstimator(double floor = 0.05, double ceiling = 3.0) : minimum(floor), maximum(ceiling), rto(ceiling) {}
+
+        void sample(double rtt)
+        {
+            if (samples == 0)
+            {
+                srtt = rtt;
+                rttvar = rtt / 2.0;
+            }
+            else
+            {
+                rttvar = 0.75 * rttvar + 0.25 * std::fabs(srtt - rtt);
+                srtt = 0.875 * srtt + 0.125 * rtt;
+            }
+            samples++;
+            rto = clamp(srtt + 4.0 * rttvar);
+        }
+
+        void backoff()
+        {
+            rto = clamp(rto * 2.0);
+        }
+
+        double timeout() const
+        {
+            return rto;
+        }
+
+        double smoothed() const
+        {
+            return srtt;
+        }
+
+        double floor() const
+        {
+            return minimum;
+        }
+
+        double ceiling() const
+        {
+            return maximum;
+        }
+
+    private:
+        double clamp(double value) const
+        {
+            return value < minimum ? minimum : (value > maximum ? maximum : value);
+        }
+
+        double minimum, maximum;
+        double rto, srtt { 0 }, rttvar { 0 };
+        unsigned long samples { 0 };
+};
+
+/**************************************************************************************
+** Recursive least squares fit of y = intercept + slope * x with exponential forgetting.
+** Each update is O(1). The slope variance comes from the inverse information matrix
+** scaled by the weighted residual variance. x is taken relative to the first sample.
+***************************************************************************************/
+class LinearRls
+{
+    public:
+        explicit LinearRls(double forgetting = 1.0) : lambda(forgetting)
+        {
+            reset();
+        }
+
+        void setForgetting(double forgetting)
+        {
+            lambda = forgetting;
+        }
+
+        void reset()
+        {
+            theta[0] = theta[1] = 0;
+            P[0][0] = P[1][1] = 1e6;
+            P[0][1] = P[1][0] = 0;
+            residuals = weight = 0;
+            n = 0;
+        }
+
+        void add(double x, double y)
+        {
+            if (n == 0)
+                origin = x;
+            double h[2] = { 1.0, x - origin };
+            double Ph[2] = { P[0][0] * h[0] + P[0][1] * h[1], P[1][0] * h[0] + P[1][1] * h[1] };
+            double denominator = lambda + h[0] * Ph[0] + h[1] * Ph[1];
+            double gain[2] = { Ph[0] / denominator, Ph[1] / denominator };
+            double prior = y - (theta[0] + theta[1] * h[1]);
+            theta[0] += gain[0] * prior;
+            theta[1] += gain[1] * prior;
+            double posterior = y - (theta[0] + theta[1] * h[1]);
+            for (int i = 0; i < 2; i++)
+                for (int j = 0; j < 2; j++)
+                    P[i][j] = (P[i][j] - gain[i] * Ph[j]) / lambda;
+            residuals = lambda * residuals + prior * posterior;
+            weight = lambda * weight + 1.0;
+            n++;
+        }
+
+        // shift all recorded y by offset, e.g. after the position was re-synced
+        void shift(double offset)
+        {
+            theta[0] += offset;
+        }
+
+        unsigned long count() const
+        {
+            return n;
+        }
+
+        double slope() const
+        {
+            return theta[1];
+        }
+
+        double predict(double x) const
+        {
+            return theta[0] + theta[1] * (x - origin);
+        }
+
+        double residualVariance() const
+        {
+            return (weight > 2.0) ? std::max(residuals, 0.0) / (weight - 2.0) : 0;
+        }
+
+        double slopeError() const
+        {
+            return std::sqrt(residualVariance() * std::max(P[1][1], 0.0));
+        }
+
+        // effective degrees of freedom, the forgetting factor discounts old points
+        double degreesOfFreedom() const
+        {
+            return weight - 2.0;
+        }
+
+        // enough effective points for a finite slope interval
+        bool ready() const
+        {
+            return degreesOfFreedom() >= 1.0;
+        }
+
+        // half width of the 95% confidence interval of the slope, infinite until ready()
+        double slopeInterval() const
+        {
+            return ready() ? studentT975(degreesOfFreedom()) * slopeError() : HUGE_VAL;
+        }
+
+        // two sided 95% Student-t quantile, interpolated linearly in 1/dof between table entries
+        static double studentT975(double dof)
+        {
+            static const double table[][2] =
+            {
+                { 1, 12.706 }, { 2, 4.303 }, { 3, 3.182 }, { 4, 2.776 }, { 5, 2.571 }, { 6, 2.447 },
+                { 7, 2.365 }, { 8, 2.306 }, { 9, 2.262 }, { 10, 2.228 }, { 12, 2.179 }, { 15, 2.131 },
+                { 20, 2.086 }, { 30, 2.042 }, { 40, 2.021 }, { 60, 2.000 }, { 120, 1.980 }
+            };
+            const size_t n = sizeof(table) / sizeof(table[0]);
+            if (dof <= table[0][0])
+                return table[0][1];
+            for (size_t i = 1; i < n; i++)
+            {
+                if (dof <= table[i][0])
+                {
+                    double f = (1.0 / table[i - 1][0] - 1.0 / dof) / (1.0 / table[i - 1][0] - 1.0 / table[i][0]);
+                    return table[i - 1][1] + f * (table[i][1] - table[i - 1][1]);
+                }
+            }
+            // towards the normal quantile 1.96 at infinity
+            double f = 1.0 - table[n - 1][0] / dof;
+            return table[n - 1][1] + f * (1.960 - table[n - 1][1]);
+        }
+
+    private:
+        double lambda;
+        double theta[2], P[2][2];
+        double residuals { 0 }, weight { 0 }, origin { 0 };
+        unsigned long n { 0 };
+};
+
+#endif
@@ -0,0 +1,145 @@
+/*******************************************************************************
+ Copyright(c) 2024 astrojolo.com
+ .
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#ifndef ASTROLINK4_TRACE_H
+#define ASTROLINK4_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <cstring>
+#include <atomic>
+#include <algorithm>
+
+/**************************************************************************************
+** Always-on flight recorder. Records are fixed 64 byte slots in a power of two ring,
+** a writer claims a slot with one atomic increment and stamps the slot sequence last,
+** so recording needs no lock and a reader can drop slots that were being overwritten.
+** Data longer than one slot continues in the following slots, claimed together with the
+** first one so the chain is contiguous in sequence.
+** The dump file is the header followed by the raw ring, astrolink4_tracedump decodes it.
+** All fields are stored in host byte order.
+***************************************************************************************/
+
+#define TRACE_MAGIC "AL4TRC"
+#define TRACE_VERSION 2
+#define TRACE_CAPACITY 4096
+#define TRACE_DATA_LEN 40
+#define TRACE_MAX_DATA 1024        // longest data kept for one record, spread over continuation slots
+
+enum TraceRecordType
+{
+    TRACE_COMMAND = 1,          // data: command, value: attempt
+    TRACE_REPLY = 2,            // data: reply, value: round trip [us]
+    TRACE_TIMEOUT = 3,          // data: command, value: timeout [ms]
+    TRACE_SERIAL_ERROR = 4,     // data: command, value: tty error code
+    TRACE_STATE = 5,            // data: property or subsystem, value: new state
+    TRACE_PARSE_ERROR = 6,      // data: error text
+    TRACE_EVENT = 7,            // data: event text, value: event specific
+    TRACE_CONTINUATION = 8      // data: next part of the previous record, value: offset in its data
+};
+
+#pragma pack(push, 1)
+struct TraceRecord
+{
+    uint64_t sequence;          // claimed sequence + 1, 0 = empty slot
+    uint64_t timestamp;         // CLOCK_MONOTONIC [ns]
+    uint16_t type;
+    uint16_t length;
+    int32_t value;
+    char data[TRACE_DATA_LEN];
+};
+
+struct TraceFileHeader
+{
+    char magic[6];
+    uint16_t version;
+    uint32_t capacity;
+    uint32_t recordSize;
+    uint64_t wallTime;          // wall clock at dump [us since epoch]
+    uint64_t monotonicTime;     // CLOCK_MONOTONIC at dump [ns]
+};
+#pragma pack(pop)
+
+static_assert(sizeof(TraceRecord) == 64, "trace record must stay one cache line");
+
+class FlightRecorder
+{
+    public:
+        FlightRecorder()
+        {
+            memset(ring, 0, sizeof(ring));
+        }
+
+        void record(TraceRecordType type, int32_t value, const char *data, size_t length)
+        {
+            if (length > TRACE_MAX_DATA)
+                length = TRACE_MAX_DATA;
+            size_t slots = (length > TRACE_DATA_LEN) ? (length + TRACE_DATA_LEN - 1) / TRACE_DATA_LEN : 1;
+            uint64_t sequence = next.fetch_add(slots, std::memory_order_relaxed);
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            uint64_t timestamp = static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+            for (size_t i = 0, offset = 0; i < slots; i++, offset += TRACE_DATA_LEN)
+            {
+                TraceRecord &slot = ring[(sequence + i) & (TRACE_CAPACITY - 1)];
+                slot.sequence = 0;
+                std::atomic_thread_fence(std::memory_order_release);
+                slot.timestamp = timestamp;
+                slot.type = (i == 0) ? type : TRACE_CONTINUATION;
+                slot.value = (i == 0) ? value : static_cast<int32_t>(offset);
+                slot.length = std::min<size_t>(length - offset, TRACE_DATA_LEN);
+                if (slot.length > 0)
+                    memcpy(slot.data, data + offset, slot.length);
+                std::atomic_thread_fence(std::memory_order_release);
+                slot.sequence = sequence + i + 1;
+            }
+        }
+
+        void record(TraceRecordType type, int32_t value, const char *text = nullptr)
+        {
+            record(type, value, text, text ? strlen(text) : 0);
+        }
+
+        bool dump(const char *path) const
+        {
+            FILE *file = fopen(path, "wb");
+            if (!file)
+                return false;
+
+            TraceFileHeader header;
+            memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+            header.version = TRACE_VERSION;
+            header.capacity = TRACE_CAPACITY;
+            header.recordSize = sizeof(TraceRecord);
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            header.wallTime = static_cast<uint64_t>(ts.tv_sec) * 1000000ull + ts.tv_nsec / 1000;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            header.monotonicTime = static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+
+            bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(ring, sizeof(ring), 1, file) == 1;
+            return (fclose(file) == 0) && ok;
+        }
+
+    private:
+        std::atomic<uint64_t> next { 0 };
+        TraceRecord ring[TRACE_CAPACITY];
+};
+
+#endif
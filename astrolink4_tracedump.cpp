@@ -0,0 +1,127 @@
+/*******************************************************************************
+ Copyright(c) 2024 astrojolo.com
+ .
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+/**************************************************************************************
+** Converts a flight recorder dump written by the driver to text, oldest record first.
+***************************************************************************************/
+
+#include "astrolink4_trace.h"
+
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+static const char *typeName(uint16_t type)
+{
+    switch (type)
+    {
+        case TRACE_COMMAND:
+            return "CMD";
+        case TRACE_REPLY:
+            return "RES";
+        case TRACE_TIMEOUT:
+            return "TIMEOUT";
+        case TRACE_SERIAL_ERROR:
+            return "SERIAL";
+        case TRACE_STATE:
+            return "STATE";
+        case TRACE_PARSE_ERROR:
+            return "PARSE";
+        case TRACE_EVENT:
+            return "EVENT";
+        case TRACE_CONTINUATION:
+            return "CONT";
+        default:
+            return "?";
+    }
+}
+
+static const char *stateName(int32_t state)
+{
+    static const char *names[] = { "Idle", "Ok", "Busy", "Alert" };
+    return (state >= 0 && state <= 3) ? names[state] : "?";
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s trace_file\n", argv[0]);
+        return 1;
+    }
+
+    FILE *file = fopen(argv[1], "rb");
+    if (!file)
+    {
+        fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return 1;
+    }
+
+    TraceFileHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != TRACE_VERSION || header.recordSize != sizeof(TraceRecord))
+    {
+        fprintf(stderr, "%s is not a flight recorder dump\n", argv[1]);
+        fclose(file);
+        return 1;
+    }
+
+    std::vector<TraceRecord> records(header.capacity);
+    size_t count = fread(records.data(), sizeof(TraceRecord), header.capacity, file);
+    fclose(file);
+    records.resize(count);
+
+    // keep only slots whose sequence belongs to them, a torn slot was being rewritten during the dump
+    std::vector<TraceRecord> valid;
+    for (size_t i = 0; i < records.size(); i++)
+        if (records[i].sequence != 0 && ((records[i].sequence - 1) & (header.capacity - 1)) == i)
+            valid.push_back(records[i]);
+    records.swap(valid);
+    std::sort(records.begin(), records.end(), [](const TraceRecord & a, const TraceRecord & b)
+    {
+        return a.sequence < b.sequence;
+    });
+
+    time_t dumpTime = header.wallTime / 1000000;
+    char timeText[32];
+    strftime(timeText, sizeof(timeText), "%Y-%m-%d %H:%M:%S", localtime(&dumpTime));
+    printf("# dump at %s, %zu records, times relative to the dump [s]\n", timeText, records.size());
+
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const TraceRecord &r = records[i];
+        double t = (static_cast<double>(r.timestamp) - static_cast<double>(header.monotonicTime)) / 1e9;
+        std::string data(r.data, std::min<size_t>(r.length, TRACE_DATA_LEN));
+        // join the continuation slots that follow in sequence, a continuation whose head was
+        // overwritten is printed on its own with its offset
+        while (r.type != TRACE_CONTINUATION && i + 1 < records.size() && records[i + 1].type == TRACE_CONTINUATION &&
+                records[i + 1].sequence == records[i].sequence + 1 && static_cast<size_t>(records[i + 1].value) == data.size())
+        {
+            i++;
+            data.append(records[i].data, std::min<size_t>(records[i].length, TRACE_DATA_LEN));
+        }
+        if (r.type == TRACE_STATE)
+            printf("%12.6f %8llu %-8s %s %s\n", t, static_cast<unsigned long long>(r.sequence - 1), typeName(r.type), data.c_str(),
+                   stateName(r.value));
+        else
+            printf("%12.6f %8llu %-8s %6d %s\n", t, static_cast<unsigned long long>(r.sequence - 1), typeName(r.type), r.value,
+                   data.c_str());
+    }
+    return 0;
+}
@@ -23,16 +23,32 @@
 #define VERSION_MINOR 2
 
 #define ASTROLINK4_LEN 250
-#define ASTROLINK4_TIMEOUT 3
+#define ASTROLINK4_RETRIES 2
 
 #define POLL_PERIOD 500
+#define DIAGNOSTICS_POLLS 10
+#define FAST_POLL_PERIOD 100
+#define FAST_POLL_HOLD 30
+#define VIN_DEVIATION 0.5
+#define PROTECTION_LOG_SIZE 100
+#define ESTIMATE_ERROR_ALPHA 0.1
+#define FLIGHT_RECORDER_DUMP_INTERVAL 60
+#define WEATHER_STALE_TIME 10
+#define HUMIDITY_HYSTERESIS 5.0
+#define DEW_CONTROL_PERIOD 10
+#define LOAD_SETTLE_TIME 0.5
+#define LOAD_MEASURE_TIME 2.0
+#define LOAD_MIN_CHANGE 0.1
+#define LOAD_ALPHA 0.3
 
 #include <memory>
+#include <stdexcept>
 
 /**************************************************************************************
 ** Initialization stuff
 ***************************************************************************************/
 std::unique_ptr<AstroLink4micro> astroLink4micro(new AstroLink4micro());
+std::atomic<bool> AstroLink4micro::flightRecorderSignalPending { false };
 
 AstroLink4micro::AstroLink4micro() : FI(this), WI(this)
 {
@@ -51,7 +67,8 @@ bool AstroLink4micro::initProperties()
                       FOCUSER_CAN_REL_MOVE |
                       FOCUSER_CAN_REVERSE  |
                       FOCUSER_CAN_SYNC     |
-                      FOCUSER_CAN_ABORT);
+                      FOCUSER_CAN_ABORT    |
+                      FOCUSER_HAS_BACKLASH);
 
     FI::initProperties(FOCUS_TAB);
     WI::initProperties(ENVIRONMENT_TAB, ENVIRONMENT_TAB);
@@ -81,6 +98,73 @@ bool AstroLink4micro::initProperties()
     IUFillSwitch(&Focuser1ModeS[FS1_MODE_MICRO_L], "FS1_MODE_MICRO_L", "Microstep 1/8", ISS_OFF);
     IUFillSwitch(&Focuser1ModeS[FS1_MODE_MICRO_H], "FS1_MODE_MICRO_H", "Microstep 1/32", ISS_OFF);
     IUFillSwitchVector(&Focuser1ModeSP, Focuser1ModeS, 3, getDeviceName(), "FOCUSER1_MODE", "Focuser mode", SETTINGS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);    
+
+    // temperature vs focus model
+    IUFillSwitch(&FocusModelS[FM_RECORD], "FM_RECORD", "Record focus", ISS_OFF);
+    IUFillSwitch(&FocusModelS[FM_APPLY], "FM_APPLY", "Apply slope", ISS_OFF);
+    IUFillSwitch(&FocusModelS[FM_RESET], "FM_RESET", "Reset", ISS_OFF);
+    IUFillSwitchVector(&FocusModelSP, FocusModelS, 3, getDeviceName(), "FOCUS_TEMP_MODEL", "Temperature model", FOCUS_TAB, IP_RW, ISR_ATMOST1, 60, IPS_IDLE);
+    IUFillSwitch(&FocusModelSourceS[FMSRC_SENSOR1], "FMSRC_SENSOR1", "Sensor 1", ISS_ON);
+    IUFillSwitch(&FocusModelSourceS[FMSRC_SENSOR2], "FMSRC_SENSOR2", "Sensor 2", ISS_OFF);
+    IUFillSwitchVector(&FocusModelSourceSP, FocusModelSourceS, 2, getDeviceName(), "FOCUS_MODEL_SOURCE", "Model temperature", FOCUS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    IUFillNumber(&FocusModelSettingsN[FMSET_FORGETTING], "FMSET_FORGETTING", "Forgetting factor", "%.3f", 0.5, 1, 0.01, 0.98);
+    IUFillNumber(&FocusModelSettingsN[FMSET_AUTO_CI], "FMSET_AUTO_CI", "Auto apply if 95% CI below [steps/C]", "%.2f", 0, 1000, 1, 0);
+    IUFillNumberVector(&FocusModelSettingsNP, FocusModelSettingsN, 2, getDeviceName(), "FOCUS_MODEL_SETTINGS", "Model settings", FOCUS_TAB, IP_RW, 60, IPS_IDLE);
+    IUFillNumber(&FocusModelN[FMD_SLOPE], "FMD_SLOPE", "Slope [steps/C]", "%.2f", -10000, 10000, 0, 0);
+    IUFillNumber(&FocusModelN[FMD_CI], "FMD_CI", "95% CI [steps/C]", "%.2f", 0, 10000, 0, 0);
+    IUFillNumber(&FocusModelN[FMD_POINTS], "FMD_POINTS", "Points", "%.0f", 0, 100000, 0, 0);
+    IUFillNumber(&FocusModelN[FMD_RESIDUAL], "FMD_RESIDUAL", "Residual std dev [steps]", "%.1f", 0, 100000, 0, 0);
+    IUFillNumber(&FocusModelN[FMD_PREDICTED], "FMD_PREDICTED", "Predicted focus [steps]", "%.0f", -1e9, 1e9, 0, 0);
+    IUFillNumberVector(&FocusModelNP, FocusModelN, 5, getDeviceName(), "FOCUS_MODEL", "Temperature model", FOCUS_TAB, IP_RO, 60, IPS_IDLE);
+
+    // interpolated position between polls
+    IUFillNumber(&FocusInterpolationN[0], "FOCUS_INTERPOLATION_RATE", "Rate [Hz], 0 = off", "%.0f", 0, 50, 1, 5);
+    IUFillNumberVector(&FocusInterpolationNP, FocusInterpolationN, 1, getDeviceName(), "FOCUS_INTERPOLATION", "Position updates", OPTIONS_TAB, IP_RW, 60, IPS_IDLE);
+    IUFillNumber(&FocusEstimateN[FE_LAST], "FE_LAST", "Last error [steps]", "%.0f", -1e9, 1e9, 0, 0);
+    IUFillNumber(&FocusEstimateN[FE_MEAN], "FE_MEAN", "Mean abs error [steps]", "%.1f", 0, 1e9, 0, 0);
+    IUFillNumber(&FocusEstimateN[FE_MAX], "FE_MAX", "Max abs error [steps]", "%.0f", 0, 1e9, 0, 0);
+    IUFillNumber(&FocusEstimateN[FE_SAMPLES], "FE_SAMPLES", "Corrections", "%.0f", 0, 1e9, 0, 0);
+    IUFillNumberVector(&FocusEstimateNP, FocusEstimateN, 4, getDeviceName(), "FOCUS_ESTIMATE_ERROR", "Position estimate", DIAGNOSTICS_TAB, IP_RO, 60, IPS_IDLE);
+
+    // backlash compensation, every target is approached from the same side
+    IUFillSwitch(&FocusApproachS[APPROACH_OUTWARD], "APPROACH_OUTWARD", "Outward", ISS_ON);
+    IUFillSwitch(&FocusApproachS[APPROACH_INWARD], "APPROACH_INWARD", "Inward", ISS_OFF);
+    IUFillSwitchVector(&FocusApproachSP, FocusApproachS, 2, getDeviceName(), "FOCUS_APPROACH", "Final approach", FOCUS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    IUFillNumber(&FocusBacklashStatsN[FBS_TOTAL], "FBS_TOTAL", "Total steps", "%.0f", 0, 1e12, 0, 0);
+    IUFillNumber(&FocusBacklashStatsN[FBS_OVERSHOOT], "FBS_OVERSHOOT", "Overshoot steps", "%.0f", 0, 1e12, 0, 0);
+    IUFillNumber(&FocusBacklashStatsN[FBS_MOVES], "FBS_MOVES", "Overshoot moves", "%.0f", 0, 1e12, 0, 0);
+    IUFillNumberVector(&FocusBacklashStatsNP, FocusBacklashStatsN, 3, getDeviceName(), "FOCUS_TRAVEL", "Travel", FOCUS_TAB, IP_RO, 60, IPS_IDLE);
+
+    // second focuser axis
+    IUFillNumber(&Focuser2AbsPosN[0], "FOCUS2_ABS_POSITION", "Steps", "%.0f", 0, 100000, 1000, 0);
+    IUFillNumberVector(&Focuser2AbsPosNP, Focuser2AbsPosN, 1, getDeviceName(), "FOCUS2_ABS_POSITION", "Absolute position", FOCUSER2_TAB, IP_RW, 60, IPS_IDLE);
+    IUFillNumber(&Focuser2RelPosN[0], "FOCUS2_RELATIVE_POSITION", "Steps", "%.0f", 0, 50000, 100, 100);
+    IUFillNumberVector(&Focuser2RelPosNP, Focuser2RelPosN, 1, getDeviceName(), "FOCUS2_REL_POSITION", "Relative position", FOCUSER2_TAB, IP_RW, 60, IPS_IDLE);
+    IUFillSwitch(&Focuser2MotionS[F2_INWARD], "FOCUS2_INWARD", "Focus In", ISS_ON);
+    IUFillSwitch(&Focuser2MotionS[F2_OUTWARD], "FOCUS2_OUTWARD", "Focus Out", ISS_OFF);
+    IUFillSwitchVector(&Focuser2MotionSP, Focuser2MotionS, 2, getDeviceName(), "FOCUS2_MOTION", "Direction", FOCUSER2_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    IUFillSwitch(&Focuser2AbortS[0], "ABORT", "Soft stop", ISS_OFF);
+    IUFillSwitchVector(&Focuser2AbortSP, Focuser2AbortS, 1, getDeviceName(), "FOCUS2_ABORT_MOTION", "Soft stop", FOCUSER2_TAB, IP_RW, ISR_ATMOST1, 60, IPS_IDLE);
+    IUFillNumber(&Focuser2SyncN[0], "FOCUS2_SYNC_VALUE", "Steps", "%.0f", 0, 100000, 1000, 0);
+    IUFillNumberVector(&Focuser2SyncNP, Focuser2SyncN, 1, getDeviceName(), "FOCUS2_SYNC", "Sync", FOCUSER2_TAB, IP_RW, 60, IPS_IDLE);
+    IUFillNumber(&Focuser2MaxPosN[0], "FOCUS2_MAX_VALUE", "Steps", "%.0f", 1000, 1000000, 1000, 100000);
+    IUFillNumberVector(&Focuser2MaxPosNP, Focuser2MaxPosN, 1, getDeviceName(), "FOCUS2_MAX", "Max. position", FOCUSER2_TAB, IP_RW, 60, IPS_IDLE);
+    IUFillSwitch(&Focuser2ReverseS[F2_REVERSE_ENABLED], "INDI_ENABLED", "Enabled", ISS_OFF);
+    IUFillSwitch(&Focuser2ReverseS[F2_REVERSE_DISABLED], "INDI_DISABLED", "Disabled", ISS_ON);
+    IUFillSwitchVector(&Focuser2ReverseSP, Focuser2ReverseS, 2, getDeviceName(), "FOCUS2_REVERSE_MOTION", "Reverse motion", FOCUSER2_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+
+    IUFillNumber(&Focuser2SettingsN[FS1_SPEED], "FS2_SPEED", "Speed [pps]", "%.0f", 10, 200, 1, 100);
+    IUFillNumber(&Focuser2SettingsN[FS1_CURRENT], "FS2_CURRENT", "Current [mA]", "%.0f", 100, 2000, 100, 400);
+    IUFillNumber(&Focuser2SettingsN[FS1_HOLD], "FS2_HOLD", "Hold torque [%]", "%.0f", 0, 100, 10, 0);
+    IUFillNumber(&Focuser2SettingsN[FS1_STEP_SIZE], "FS2_STEP_SIZE", "Step size [um]", "%.2f", 0, 100, 0.1, 5.0);
+    IUFillNumber(&Focuser2SettingsN[FS1_COMPENSATION], "FS2_COMPENSATION", "Compensation [steps/C]", "%.2f", -1000, 1000, 1, 0);
+    IUFillNumber(&Focuser2SettingsN[FS1_COMP_THRESHOLD], "FS2_COMP_THRESHOLD", "Compensation threshold [steps]", "%.0f", 1, 1000, 10, 10);
+    IUFillNumberVector(&Focuser2SettingsNP, Focuser2SettingsN, 6, getDeviceName(), "FOCUSER2_SETTINGS", "Focuser 2 settings", FOCUSER2_TAB, IP_RW, 60, IPS_IDLE);
+
+    IUFillSwitch(&Focuser2ModeS[FS1_MODE_UNI], "FS2_MODE_UNI", "Unipolar", ISS_ON);
+    IUFillSwitch(&Focuser2ModeS[FS1_MODE_MICRO_L], "FS2_MODE_MICRO_L", "Microstep 1/8", ISS_OFF);
+    IUFillSwitch(&Focuser2ModeS[FS1_MODE_MICRO_H], "FS2_MODE_MICRO_H", "Microstep 1/32", ISS_OFF);
+    IUFillSwitchVector(&Focuser2ModeSP, Focuser2ModeS, 3, getDeviceName(), "FOCUSER2_MODE", "Focuser 2 mode", FOCUSER2_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
     
     // Power readings
     IUFillNumber(&PowerDataN[POW_VIN], "VIN", "Input voltage [V]", "%.1f", 0, 15, 10, 0);
@@ -88,6 +172,50 @@ bool AstroLink4micro::initProperties()
     IUFillNumber(&PowerDataN[POW_AH], "AH", "Energy consumed [Ah]", "%.2f", 0, 1000, 10, 0);
     IUFillNumber(&PowerDataN[POW_WH], "WH", "Energy consumed [Wh]", "%.2f", 0, 10000, 10, 0);
     IUFillNumberVector(&PowerDataNP, PowerDataN, 4, getDeviceName(), "POWER_DATA", "Power data", POWER_TAB, IP_RO, 60, IPS_IDLE);
+
+    // Power profiling
+    IUFillSwitch(&PowerProfileS[PP_ON], "PP_ON", "Start", ISS_OFF);
+    IUFillSwitch(&PowerProfileS[PP_OFF], "PP_OFF", "Stop", ISS_ON);
+    IUFillSwitchVector(&PowerProfileSP, PowerProfileS, 2, getDeviceName(), "POWER_PROFILE", "Power profiling", POWER_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    IUFillNumber(&PowerProfileSettingsN[PPS_BURST], "PPS_BURST", "Burst sampling after change [s]", "%.0f", 1, 60, 1, 5);
+    IUFillNumber(&PowerProfileSettingsN[PPS_CAPACITY], "PPS_CAPACITY", "Battery capacity [Ah], 0 = mains", "%.1f", 0, 1000, 1, 0);
+    IUFillNumber(&PowerProfileSettingsN[PPS_RESERVE], "PPS_RESERVE", "Battery reserve [%]", "%.0f", 0, 90, 5, 20);
+    IUFillNumberVector(&PowerProfileSettingsNP, PowerProfileSettingsN, 3, getDeviceName(), "POWER_PROFILE_SETTINGS", "Profiling settings", POWER_TAB, IP_RW, 60, IPS_IDLE);
+    IUFillNumber(&PowerProfileN[PPD_DURATION], "PPD_DURATION", "Duration [h]", "%.2f", 0, 1e6, 0, 0);
+    IUFillNumber(&PowerProfileN[PPD_ENERGY], "PPD_ENERGY", "Energy [Wh]", "%.2f", 0, 1e9, 0, 0);
+    IUFillNumber(&PowerProfileN[PPD_CHARGE], "PPD_CHARGE", "Charge [Ah]", "%.3f", 0, 1e9, 0, 0);
+    IUFillNumber(&PowerProfileN[PPD_POWER], "PPD_POWER", "Average power [W]", "%.2f", 0, 1e6, 0, 0);
+    IUFillNumber(&PowerProfileN[PPD_PEAK], "PPD_PEAK", "Peak current [A]", "%.2f", 0, 100, 0, 0);
+    IUFillNumber(&PowerProfileN[PPD_RUNTIME], "PPD_RUNTIME", "Battery runtime [h]", "%.1f", 0, 1e6, 0, 0);
+    IUFillNumberVector(&PowerProfileNP, PowerProfileN, 6, getDeviceName(), "POWER_PROFILE_DATA", "Profile", POWER_TAB, IP_RO, 60, IPS_IDLE);
+    IUFillNumber(&PowerLoadN[LOAD_OUT1], "LOAD_OUT1", "OUT1 load [A]", "%.2f", -100, 100, 0, 0);
+    IUFillNumber(&PowerLoadN[LOAD_OUT2], "LOAD_OUT2", "OUT2 load [A]", "%.2f", -100, 100, 0, 0);
+    IUFillNumber(&PowerLoadN[LOAD_OUT3], "LOAD_OUT3", "OUT3 load [A]", "%.2f", -100, 100, 0, 0);
+    IUFillNumber(&PowerLoadN[LOAD_PWM1], "LOAD_PWM1", "PWM1 load at 100% [A]", "%.2f", -100, 100, 0, 0);
+    IUFillNumber(&PowerLoadN[LOAD_PWM2], "LOAD_PWM2", "PWM2 load at 100% [A]", "%.2f", -100, 100, 0, 0);
+    IUFillNumber(&PowerLoadN[INRUSH_OUT1], "INRUSH_OUT1", "OUT1 inrush [A]", "%.2f", -100, 100, 0, 0);
+    IUFillNumber(&PowerLoadN[INRUSH_OUT2], "INRUSH_OUT2", "OUT2 inrush [A]", "%.2f", -100, 100, 0, 0);
+    IUFillNumber(&PowerLoadN[INRUSH_OUT3], "INRUSH_OUT3", "OUT3 inrush [A]", "%.2f", -100, 100, 0, 0);
+    IUFillNumber(&PowerLoadN[INRUSH_PWM1], "INRUSH_PWM1", "PWM1 inrush [A]", "%.2f", -100, 100, 0, 0);
+    IUFillNumber(&PowerLoadN[INRUSH_PWM2], "INRUSH_PWM2", "PWM2 inrush [A]", "%.2f", -100, 100, 0, 0);
+    IUFillNumberVector(&PowerLoadNP, PowerLoadN, 10, getDeviceName(), "POWER_LOADS", "Output loads", POWER_TAB, IP_RO, 60, IPS_IDLE);
+
+    // Protection
+    IUFillLight(&ProtectionL[PROT_OVERVOLTAGE], "PROT_OVERVOLTAGE", "Over-voltage", IPS_IDLE);
+    IUFillLight(&ProtectionL[PROT_OVERCURRENT], "PROT_OVERCURRENT", "Over-current", IPS_IDLE);
+    IUFillLightVector(&ProtectionLP, ProtectionL, 2, getDeviceName(), "PROTECTION_ALARM", "Protection", POWER_TAB, IPS_IDLE);
+    for (int i = 0; i < 5; i++)
+    {
+        char name[MAXINDINAME], label[MAXINDILABEL];
+        snprintf(name, MAXINDINAME, "PROT_EVENT_%d", i + 1);
+        snprintf(label, MAXINDILABEL, "Event %d", i + 1);
+        IUFillText(&ProtectionLogT[i], name, label, "");
+    }
+    IUFillTextVector(&ProtectionLogTP, ProtectionLogT, 5, getDeviceName(), "PROTECTION_LOG", "Protection events", POWER_TAB, IP_RO, 60, IPS_IDLE);
+    IUFillNumber(&ProtectionSettingsN[PS_OVERVOLTAGE], "PS_OVERVOLTAGE", "Over-voltage [V]", "%.0f", 10, 20, 1, 15);
+    IUFillNumber(&ProtectionSettingsN[PS_OVERCURRENT], "PS_OVERCURRENT", "Over-current [A]", "%.0f", 1, 15, 1, 10);
+    IUFillNumber(&ProtectionSettingsN[PS_OVERTIME], "PS_OVERTIME", "Trip delay [ms]", "%.0f", 0, 10000, 10, 100);
+    IUFillNumberVector(&ProtectionSettingsNP, ProtectionSettingsN, 3, getDeviceName(), "PROTECTION_SETTINGS", "Protection settings", SETTINGS_TAB, IP_RW, 60, IPS_IDLE);
     
 	IUFillText(&RelayLabelsT[LAB_OUT1], "LAB_OUT1", "OUT 1", "OUT 1");
 	IUFillText(&RelayLabelsT[LAB_OUT2], "LAB_OUT2", "OUT 2", "OUT 2");
@@ -97,10 +225,58 @@ bool AstroLink4micro::initProperties()
 	IUFillTextVector(&RelayLabelsTP, RelayLabelsT, 5, getDeviceName(), "RELAYLABELS", "Relay Labels", OPTIONS_TAB, IP_RW, 60, IPS_IDLE);    
 	IUFillNumber(&SQMOffsetN[0], "SQMOffset", "mag/arcsec2", "%0.2f", -1, 1, 0.01, 0);
 	IUFillNumberVector(&SQMOffsetNP, SQMOffsetN, 1, getDeviceName(), "SQMOFFSET", "SQM calibration", OPTIONS_TAB, IP_RW, 60, IPS_IDLE);    
+	IUFillNumber(&SQMIntegrationSettingsN[SQMS_TARGET], "SQMS_TARGET", "Target uncertainty [mag/arcsec2]", "%0.3f", 0.001, 0.1, 0.001, 0.01);
+	IUFillNumber(&SQMIntegrationSettingsN[SQMS_MAX_SAMPLES], "SQMS_MAX_SAMPLES", "Max samples", "%0.0f", 1, 1200, 10, 240);
+	IUFillNumber(&SQMIntegrationSettingsN[SQMS_NOISE_FLOOR], "SQMS_NOISE_FLOOR", "Publish threshold [mag/arcsec2]", "%0.3f", 0, 0.2, 0.005, 0.02);
+	IUFillNumberVector(&SQMIntegrationSettingsNP, SQMIntegrationSettingsN, 3, getDeviceName(), "SQM_INTEGRATION_SETTINGS", "SQM averaging", OPTIONS_TAB, IP_RW, 60, IPS_IDLE);
+	IUFillNumber(&SQMIntegrationN[SQMI_VALUE], "SQMI_VALUE", "Sky brightness [mag/arcsec2]", "%0.2f", 0, 30, 0, 0);
+	IUFillNumber(&SQMIntegrationN[SQMI_UNCERTAINTY], "SQMI_UNCERTAINTY", "Uncertainty [mag/arcsec2]", "%0.3f", 0, 30, 0, 0);
+	IUFillNumber(&SQMIntegrationN[SQMI_SAMPLES], "SQMI_SAMPLES", "Samples averaged", "%0.0f", 0, 1200, 0, 0);
+	IUFillNumber(&SQMIntegrationN[SQMI_NOISE], "SQMI_NOISE", "Sample noise [mag/arcsec2]", "%0.3f", 0, 30, 0, 0);
+	IUFillNumberVector(&SQMIntegrationNP, SQMIntegrationN, 4, getDeviceName(), "SQM_INTEGRATION", "SQM", ENVIRONMENT_TAB, IP_RO, 60, IPS_IDLE);
+
+	// Sensors, defined when present
+	IUFillNumber(&Sensor1N[SENS_TEMP], "SENS_TEMP", "Temperature [C]", "%0.1f", -50, 50, 0, 0);
+	IUFillNumber(&Sensor1N[SENS_HUM], "SENS_HUM", "Humidity [%]", "%0.0f", 0, 100, 0, 0);
+	IUFillNumber(&Sensor1N[SENS_DEW], "SENS_DEW", "Dew point [C]", "%0.1f", -50, 50, 0, 0);
+	IUFillNumberVector(&Sensor1NP, Sensor1N, 3, getDeviceName(), "SENSOR_1", "Sensor 1", ENVIRONMENT_TAB, IP_RO, 60, IPS_IDLE);
+	IUFillNumber(&Sensor2N[SENS_TEMP], "SENS_TEMP", "Temperature [C]", "%0.1f", -50, 50, 0, 0);
+	IUFillNumberVector(&Sensor2NP, Sensor2N, 1, getDeviceName(), "SENSOR_2", "Sensor 2", ENVIRONMENT_TAB, IP_RO, 60, IPS_IDLE);
+	IUFillNumber(&SensorExtN[SENS_TEMP], "SENS_TEMP", "Temperature [C]", "%0.1f", -50, 50, 0, 0);
+	IUFillNumber(&SensorExtN[SENS_HUM], "SENS_HUM", "Humidity [%]", "%0.0f", 0, 100, 0, 0);
+	IUFillNumber(&SensorExtN[SENS_DEW], "SENS_DEW", "Dew point [C]", "%0.1f", -50, 50, 0, 0);
+	IUFillNumberVector(&SensorExtNP, SensorExtN, 3, getDeviceName(), "SENSOR_EXT", "External sensor", ENVIRONMENT_TAB, IP_RO, 60, IPS_IDLE);
+	IUFillNumber(&SkySensorN[SKY_TEMP], "SKY_TEMP", "Sky temperature [C]", "%0.1f", -100, 50, 0, 0);
+	IUFillNumber(&SkySensorN[SKY_AMBIENT], "SKY_AMBIENT", "Ambient temperature [C]", "%0.1f", -50, 50, 0, 0);
+	IUFillNumber(&SkySensorN[SKY_DIFF], "SKY_DIFF", "Temperature difference [C]", "%0.1f", -50, 100, 0, 0);
+	IUFillNumberVector(&SkySensorNP, SkySensorN, 3, getDeviceName(), "SKY_SENSOR", "Sky sensor", ENVIRONMENT_TAB, IP_RO, 60, IPS_IDLE);
+	sensorProperties[SENSOR_1] = &Sensor1NP;
+	sensorProperties[SENSOR_2] = &Sensor2NP;
+	sensorProperties[SENSOR_EXT] = &SensorExtNP;
+	sensorProperties[SENSOR_SKY] = &SkySensorNP;
+	sensorProperties[SENSOR_SQM] = &SQMIntegrationNP;
     
+	// Serial traffic capture, available before connecting so the handshake is recorded too
+	IUFillText(&CaptureFileT[0], "CAPTURE_FILE", "File", "/tmp/astrolink4micro.cap");
+	IUFillTextVector(&CaptureFileTP, CaptureFileT, 1, getDeviceName(), "SERIAL_CAPTURE_FILE", "Capture file", OPTIONS_TAB, IP_RW, 60, IPS_IDLE);
+	IUFillSwitch(&SerialCaptureS[CAP_ON], "CAP_ON", "ON", ISS_OFF);
+	IUFillSwitch(&SerialCaptureS[CAP_OFF], "CAP_OFF", "OFF", ISS_ON);
+	IUFillSwitchVector(&SerialCaptureSP, SerialCaptureS, 2, getDeviceName(), "SERIAL_CAPTURE", "Serial capture", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+	// Flight recorder, SIGUSR1 requests a dump as well
+	IUFillText(&FlightRecorderDirT[0], "FR_DIR", "Directory", "/tmp");
+	IUFillTextVector(&FlightRecorderDirTP, FlightRecorderDirT, 1, getDeviceName(), "FLIGHT_RECORDER_DIR", "Flight recorder", OPTIONS_TAB, IP_RW, 60, IPS_IDLE);
+	IUFillSwitch(&FlightRecorderDumpS[0], "FR_DUMP", "Dump", ISS_OFF);
+	IUFillSwitchVector(&FlightRecorderDumpSP, FlightRecorderDumpS, 1, getDeviceName(), "FLIGHT_RECORDER_DUMP", "Flight recorder", OPTIONS_TAB, IP_RW, ISR_ATMOST1, 60, IPS_IDLE);
+	signal(SIGUSR1, flightRecorderSignalHandler);
+
 	// Load options before connecting
 	// load config before defining switches
 	defineProperty(&RelayLabelsTP);
+	defineProperty(&CaptureFileTP);
+	defineProperty(&SerialCaptureSP);
+	defineProperty(&FlightRecorderDirTP);
+	defineProperty(&FlightRecorderDumpSP);
 	loadConfig();
         
 	IUFillSwitch(&Switch1S[S1_ON], "S1_ON", "ON", ISS_OFF);
@@ -120,14 +296,72 @@ bool AstroLink4micro::initProperties()
 
 	IUFillNumber(&PWM2N[0], "PWMout2", "%", "%0.0f", 0, 100, 10, 0);
 	IUFillNumberVector(&PWM2NP, PWM2N, 1, getDeviceName(), "PWMOUT2", RelayLabelsT[LAB_PWM2].text, POWER_TAB, IP_RW, 60, IPS_IDLE);    
+
+	// Dew heater control
+	IUFillSwitch(&DewControlS[DEW_PWM1], "DEW_PWM1", "PWM 1", ISS_OFF);
+	IUFillSwitch(&DewControlS[DEW_PWM2], "DEW_PWM2", "PWM 2", ISS_OFF);
+	IUFillSwitchVector(&DewControlSP, DewControlS, 2, getDeviceName(), "DEW_CONTROL", "Dew control", POWER_TAB, IP_RW, ISR_NOFMANY, 60, IPS_IDLE);
+	IUFillNumber(&DewSettingsN[DS_MARGIN], "DS_MARGIN", "Margin above dew point [C]", "%.1f", 0, 20, 0.5, 3);
+	IUFillNumber(&DewSettingsN[DS_KP], "DS_KP", "Proportional gain [%/C]", "%.1f", 0, 100, 1, 10);
+	IUFillNumber(&DewSettingsN[DS_KI], "DS_KI", "Integral gain [%/C/min]", "%.2f", 0, 50, 0.1, 1);
+	IUFillNumber(&DewSettingsN[DS_DEADBAND], "DS_DEADBAND", "Deadband [%]", "%.0f", 0, 50, 1, 5);
+	IUFillNumber(&DewSettingsN[DS_MAX], "DS_MAX", "Max duty [%]", "%.0f", 0, 100, 5, 100);
+	IUFillNumber(&DewSettingsN[DS_POWER1], "DS_POWER1", "PWM 1 heater power [W]", "%.1f", 0, 100, 1, 10);
+	IUFillNumber(&DewSettingsN[DS_POWER2], "DS_POWER2", "PWM 2 heater power [W]", "%.1f", 0, 100, 1, 10);
+	IUFillNumberVector(&DewSettingsNP, DewSettingsN, 7, getDeviceName(), "DEW_CONTROL_SETTINGS", "Dew control settings", POWER_TAB, IP_RW, 60, IPS_IDLE);
+	IUFillNumber(&DewStateN[DST_TARGET], "DST_TARGET", "Target [C]", "%.1f", -100, 100, 0, 0);
+	IUFillNumber(&DewStateN[DST_TEMP], "DST_TEMP", "Controlled temperature [C]", "%.1f", -100, 100, 0, 0);
+	IUFillNumber(&DewStateN[DST_ERROR], "DST_ERROR", "Error [C]", "%.2f", -100, 100, 0, 0);
+	IUFillNumber(&DewStateN[DST_DUTY1], "DST_DUTY1", "PWM 1 demand [%]", "%.0f", 0, 100, 0, 0);
+	IUFillNumber(&DewStateN[DST_DUTY2], "DST_DUTY2", "PWM 2 demand [%]", "%.0f", 0, 100, 0, 0);
+	IUFillNumber(&DewStateN[DST_ENERGY1], "DST_ENERGY1", "PWM 1 energy [Wh]", "%.2f", 0, 1e9, 0, 0);
+	IUFillNumber(&DewStateN[DST_ENERGY2], "DST_ENERGY2", "PWM 2 energy [Wh]", "%.2f", 0, 1e9, 0, 0);
+	IUFillNumberVector(&DewStateNP, DewStateN, 7, getDeviceName(), "DEW_CONTROL_STATE", "Dew control", POWER_TAB, IP_RO, 60, IPS_IDLE);
+	IUFillNumber(&DewAutomationN[DA_START], "DA_START", "Start at humidity [%]", "%.0f", 0, 100, 1, 0);
+	IUFillNumber(&DewAutomationN[DA_FULL], "DA_FULL", "Full power at humidity [%]", "%.0f", 0, 100, 1, 0);
+	IUFillNumberVector(&DewAutomationNP, DewAutomationN, 2, getDeviceName(), "DEW_AUTOMATION", "Firmware dew heater", SETTINGS_TAB, IP_RW, 60, IPS_IDLE);
     
+    // Serial link diagnostics
+    IUFillNumber(&SerialDiagN[SD_QUERY_RTT], "SD_QUERY_RTT", "Query q RTT [ms]", "%.1f", 0, 10000, 0, 0);
+    IUFillNumber(&SerialDiagN[SD_QUERY_RTO], "SD_QUERY_RTO", "Query q timeout [ms]", "%.1f", 0, 10000, 0, 0);
+    IUFillNumber(&SerialDiagN[SD_READ_RTT], "SD_READ_RTT", "Settings u RTT [ms]", "%.1f", 0, 10000, 0, 0);
+    IUFillNumber(&SerialDiagN[SD_READ_RTO], "SD_READ_RTO", "Settings u timeout [ms]", "%.1f", 0, 10000, 0, 0);
+    IUFillNumber(&SerialDiagN[SD_WRITE_RTT], "SD_WRITE_RTT", "Settings U RTT [ms]", "%.1f", 0, 10000, 0, 0);
+    IUFillNumber(&SerialDiagN[SD_WRITE_RTO], "SD_WRITE_RTO", "Settings U timeout [ms]", "%.1f", 0, 10000, 0, 0);
+    IUFillNumber(&SerialDiagN[SD_MOTION_RTT], "SD_MOTION_RTT", "Motion RTT [ms]", "%.1f", 0, 10000, 0, 0);
+    IUFillNumber(&SerialDiagN[SD_MOTION_RTO], "SD_MOTION_RTO", "Motion timeout [ms]", "%.1f", 0, 10000, 0, 0);
+    IUFillNumber(&SerialDiagN[SD_OUTPUT_RTT], "SD_OUTPUT_RTT", "Outputs RTT [ms]", "%.1f", 0, 10000, 0, 0);
+    IUFillNumber(&SerialDiagN[SD_OUTPUT_RTO], "SD_OUTPUT_RTO", "Outputs timeout [ms]", "%.1f", 0, 10000, 0, 0);
+    IUFillNumber(&SerialDiagN[SD_TIMEOUTS], "SD_TIMEOUTS", "Timeouts", "%.0f", 0, 1e9, 0, 0);
+    IUFillNumber(&SerialDiagN[SD_RETRIES], "SD_RETRIES", "Retries", "%.0f", 0, 1e9, 0, 0);
+    IUFillNumberVector(&SerialDiagNP, SerialDiagN, 12, getDeviceName(), "SERIAL_DIAGNOSTICS", "Serial link", DIAGNOSTICS_TAB, IP_RO, 60, IPS_IDLE);
+
     // Environment Group
-	addParameter("WEATHER_TEMPERATURE", "Temperature [C]", -15, 35, 15);
-	addParameter("WEATHER_HUMIDITY", "Humidity %", 0, 100, 15);
-	addParameter("WEATHER_DEWPOINT", "Dew Point [C]", -25, 20, 15);
-	addParameter("WEATHER_SKY_TEMP", "Sky temperature [C]", -50, 20, 20);
-	addParameter("WEATHER_SKY_DIFF", "Temperature difference [C]", -5, 40, 10);
-	addParameter("SQM_READING", "Sky brightness [mag/arcsec2]", 10, 25, 15);
+	// weather parameters are added from the q frames, see defineWeatherParameters()
+
+	// Weather safety evaluation over rolling windows
+	IUFillNumber(&WeatherSafetyN[WS_WINDOW], "WS_WINDOW", "Window [min]", "%.0f", 1, 120, 1, 10);
+	IUFillNumber(&WeatherSafetyN[WS_CLOUD_LIMIT], "WS_CLOUD_LIMIT", "Cloudy if sky-ambient above [C]", "%.1f", -40, 10, 1, -15);
+	IUFillNumber(&WeatherSafetyN[WS_CLOUD_VARIATION], "WS_CLOUD_VARIATION", "Cloudy if sky std dev above [C]", "%.1f", 0.1, 20, 0.1, 2);
+	IUFillNumber(&WeatherSafetyN[WS_CLOUD_HYST], "WS_CLOUD_HYST", "Cloud hysteresis [C]", "%.1f", 0, 10, 0.5, 2);
+	IUFillNumber(&WeatherSafetyN[WS_DEW_LIMIT], "WS_DEW_LIMIT", "Dew if margin below [C]", "%.1f", 0, 10, 0.5, 2);
+	IUFillNumber(&WeatherSafetyN[WS_DEW_HYST], "WS_DEW_HYST", "Dew hysteresis [C]", "%.1f", 0, 10, 0.5, 1);
+	IUFillNumber(&WeatherSafetyN[WS_HUM_LIMIT], "WS_HUM_LIMIT", "Dew if humidity above [%]", "%.0f", 50, 100, 1, 95);
+	IUFillNumberVector(&WeatherSafetyNP, WeatherSafetyN, 7, getDeviceName(), "WEATHER_SAFETY_SETTINGS", "Safety settings", ENVIRONMENT_TAB, IP_RW, 60, IPS_IDLE);
+
+	IUFillNumber(&WeatherStatsN[WST_SKY_MEAN], "WST_SKY_MEAN", "Sky-ambient mean [C]", "%.2f", -100, 100, 0, 0);
+	IUFillNumber(&WeatherStatsN[WST_SKY_STDDEV], "WST_SKY_STDDEV", "Sky-ambient std dev [C]", "%.2f", 0, 100, 0, 0);
+	IUFillNumber(&WeatherStatsN[WST_SKY_TREND], "WST_SKY_TREND", "Sky-ambient trend [C/min]", "%.3f", -100, 100, 0, 0);
+	IUFillNumber(&WeatherStatsN[WST_SKY_MIN], "WST_SKY_MIN", "Sky-ambient min [C]", "%.2f", -100, 100, 0, 0);
+	IUFillNumber(&WeatherStatsN[WST_SKY_MAX], "WST_SKY_MAX", "Sky-ambient max [C]", "%.2f", -100, 100, 0, 0);
+	IUFillNumber(&WeatherStatsN[WST_HUM_MEAN], "WST_HUM_MEAN", "Humidity mean [%]", "%.1f", 0, 100, 0, 0);
+	IUFillNumber(&WeatherStatsN[WST_HUM_TREND], "WST_HUM_TREND", "Humidity trend [%/min]", "%.3f", -100, 100, 0, 0);
+	IUFillNumber(&WeatherStatsN[WST_DEW_MEAN], "WST_DEW_MEAN", "Dew margin mean [C]", "%.2f", -100, 100, 0, 0);
+	IUFillNumber(&WeatherStatsN[WST_DEW_MIN], "WST_DEW_MIN", "Dew margin min [C]", "%.2f", -100, 100, 0, 0);
+	IUFillNumber(&WeatherStatsN[WST_DEW_TREND], "WST_DEW_TREND", "Dew margin trend [C/min]", "%.3f", -100, 100, 0, 0);
+	IUFillNumber(&WeatherStatsN[WST_SQM_MEAN], "WST_SQM_MEAN", "SQM mean [mag/arcsec2]", "%.2f", 0, 30, 0, 0);
+	IUFillNumber(&WeatherStatsN[WST_SQM_STDDEV], "WST_SQM_STDDEV", "SQM std dev [mag/arcsec2]", "%.3f", 0, 30, 0, 0);
+	IUFillNumberVector(&WeatherStatsNP, WeatherStatsN, 12, getDeviceName(), "WEATHER_STATISTICS", "Statistics", ENVIRONMENT_TAB, IP_RO, 60, IPS_IDLE);
 
     return true;    
 }
@@ -137,33 +371,117 @@ bool AstroLink4micro::updateProperties()
     // Call parent update properties first
     INDI::DefaultDevice::updateProperties();
 
+    traceState("CONNECTION", isConnected() ? IPS_OK : IPS_IDLE);
     if (isConnected())
     {
         FI::updateProperties();
-        WI::updateProperties();
         defineProperty(&Focuser1SettingsNP);
         defineProperty(&Focuser1ModeSP);
+        defineProperty(&FocusModelSP);
+        defineProperty(&FocusModelSourceSP);
+        defineProperty(&FocusModelSettingsNP);
+        defineProperty(&FocusModelNP);
+        defineProperty(&FocusApproachSP);
+        defineProperty(&FocusBacklashStatsNP);
+        defineProperty(&FocusInterpolationNP);
+        defineProperty(&FocusEstimateNP);
+        startInterpolationTimer();
+        defineProperty(&Focuser2AbsPosNP);
+        defineProperty(&Focuser2MotionSP);
+        defineProperty(&Focuser2RelPosNP);
+        defineProperty(&Focuser2AbortSP);
+        defineProperty(&Focuser2SyncNP);
+        defineProperty(&Focuser2MaxPosNP);
+        defineProperty(&Focuser2ReverseSP);
+        defineProperty(&Focuser2SettingsNP);
+        defineProperty(&Focuser2ModeSP);
 		defineProperty(&PWM1NP);
 		defineProperty(&PWM2NP);  
+        defineProperty(&DewControlSP);
+        defineProperty(&DewSettingsNP);
+        defineProperty(&DewStateNP);
+        defineProperty(&DewAutomationNP);
 		defineProperty(&Switch1SP);
 		defineProperty(&Switch2SP);            
 		defineProperty(&Switch3SP);            
         defineProperty(&PowerDataNP);   
+        defineProperty(&PowerProfileSP);
+        defineProperty(&PowerProfileSettingsNP);
+        defineProperty(&PowerProfileNP);
+        defineProperty(&PowerLoadNP);
+        defineProperty(&ProtectionLP);
+        defineProperty(&ProtectionLogTP);
+        defineProperty(&ProtectionSettingsNP);
         defineProperty(&SQMOffsetNP);    
+        defineProperty(&SQMIntegrationSettingsNP);
+        defineProperty(&WeatherSafetyNP);
+        defineProperty(&WeatherStatsNP);
+        defineProperty(&SerialDiagNP);
     }
     else
     {
+        deleteProperty(SerialDiagNP.name);
+        deleteProperty(WeatherStatsNP.name);
+        deleteProperty(WeatherSafetyNP.name);
+        for (int i = 0; i < SENSOR_N; i++)
+            updateSensorPresence(i, false);
+        deleteProperty(SQMIntegrationSettingsNP.name);
         deleteProperty(SQMOffsetNP.name);
+        deleteProperty(ProtectionSettingsNP.name);
+        deleteProperty(ProtectionLogTP.name);
+        deleteProperty(ProtectionLP.name);
         deleteProperty(PowerDataNP.name);
+        deleteProperty(PowerLoadNP.name);
+        deleteProperty(PowerProfileNP.name);
+        deleteProperty(PowerProfileSettingsNP.name);
+        deleteProperty(PowerProfileSP.name);
+        profileBurstUntil = 0;
+        loadStep.active = false;
         deleteProperty(Focuser1ModeSP.name);
         deleteProperty(Focuser1SettingsNP.name);
+        deleteProperty(FocusModelNP.name);
+        deleteProperty(FocusEstimateNP.name);
+        deleteProperty(FocusInterpolationNP.name);
+        deleteProperty(FocusBacklashStatsNP.name);
+        deleteProperty(FocusApproachSP.name);
+        backlashTarget = -1;
+        backlashLegFailed = false;
+        if (interpolationTimerID >= 0)
+            IERmTimer(interpolationTimerID);
+        interpolationTimerID = -1;
+        deleteProperty(FocusModelSettingsNP.name);
+        deleteProperty(FocusModelSourceSP.name);
+        deleteProperty(FocusModelSP.name);
+        deleteProperty(Focuser2ModeSP.name);
+        deleteProperty(Focuser2SettingsNP.name);
+        deleteProperty(Focuser2ReverseSP.name);
+        deleteProperty(Focuser2MaxPosNP.name);
+        deleteProperty(Focuser2SyncNP.name);
+        deleteProperty(Focuser2AbortSP.name);
+        deleteProperty(Focuser2RelPosNP.name);
+        deleteProperty(Focuser2MotionSP.name);
+        deleteProperty(Focuser2AbsPosNP.name);
 		deleteProperty(Switch1SP.name);
 		deleteProperty(Switch2SP.name);
 		deleteProperty(Switch3SP.name);
 		deleteProperty(PWM1NP.name);
 		deleteProperty(PWM2NP.name);
+        deleteProperty(DewControlSP.name);
+        deleteProperty(DewSettingsNP.name);
+        deleteProperty(DewStateNP.name);
+        deleteProperty(DewAutomationNP.name);
+        DewAutomationNP.s = IPS_IDLE;
         //~ deleteProperty(RelayLabelsTP.name);
-        WI::updateProperties();
+        if (weatherDefined)
+            WI::updateProperties();
+        weatherDefined = false;
+        std::fill(weatherMonitored, weatherMonitored + WP_N, false);
+        // a verdict from the previous session must not survive into the next one
+        skyDiffStats.reset();
+        humidityStats.reset();
+        dewMarginStats.reset();
+        sqmStats.reset();
+        cloudAlert = dewAlert = false;
         FI::updateProperties();        
     }
     return true;
@@ -183,11 +501,19 @@ bool AstroLink4micro::ISNewNumber(const char *dev, const char *name, double valu
         // Handle PWM
         if (!strcmp(name, PWM1NP.name))
         {
+            if (DewControlS[DEW_PWM1].s == ISS_ON)
+            {
+                DewControlS[DEW_PWM1].s = ISS_OFF;
+                IDSetSwitch(&DewControlSP, nullptr);
+                DEBUG(INDI::Logger::DBG_SESSION, "PWM 1 set by hand, dew control of this output disabled");
+            }
             bool allOk = true;
             if (PWM1N[0].value != values[0])
             {
                 sprintf(cmd, "B:0:%d", static_cast<uint8_t>(values[0]));
                 allOk = allOk && sendCommand(cmd, res);
+                if (allOk)
+                    noteOutputChange(OUTPUT_PWM1, (values[0] - PWM1N[0].value) / 100.0);
             }
             PWM1NP.s = (allOk) ? IPS_BUSY : IPS_ALERT;
             if (allOk)
@@ -197,11 +523,19 @@ bool AstroLink4micro::ISNewNumber(const char *dev, const char *name, double valu
         }     
         if (!strcmp(name, PWM2NP.name))
         {
+            if (DewControlS[DEW_PWM2].s == ISS_ON)
+            {
+                DewControlS[DEW_PWM2].s = ISS_OFF;
+                IDSetSwitch(&DewControlSP, nullptr);
+                DEBUG(INDI::Logger::DBG_SESSION, "PWM 2 set by hand, dew control of this output disabled");
+            }
             bool allOk = true;
             if (PWM2N[0].value != values[0])
             {
                 sprintf(cmd, "B:1:%d", static_cast<uint8_t>(values[0]));
                 allOk = allOk && sendCommand(cmd, res);
+                if (allOk)
+                    noteOutputChange(OUTPUT_PWM2, (values[0] - PWM2N[0].value) / 100.0);
             }
             PWM2NP.s = (allOk) ? IPS_BUSY : IPS_ALERT;
             if (allOk)
@@ -210,6 +544,33 @@ bool AstroLink4micro::ISNewNumber(const char *dev, const char *name, double valu
             return true;
         }              
         
+        // Power profiling settings
+        if (!strcmp(name, PowerProfileSettingsNP.name))
+        {
+            IUUpdateNumber(&PowerProfileSettingsNP, values, names, n);
+            PowerProfileSettingsNP.s = IPS_OK;
+            IDSetNumber(&PowerProfileSettingsNP, nullptr);
+            return true;
+        }
+        // Dew control settings
+        if (!strcmp(name, DewSettingsNP.name))
+        {
+            IUUpdateNumber(&DewSettingsNP, values, names, n);
+            DewSettingsNP.s = IPS_OK;
+            IDSetNumber(&DewSettingsNP, nullptr);
+            return true;
+        }
+        // Firmware dew heater automation, written with the next poll
+        if (!strcmp(name, DewAutomationNP.name))
+        {
+            IUUpdateNumber(&DewAutomationNP, values, names, n);
+            pendingSettings[U_HUM_START] = intToStr(DewAutomationN[DA_START].value);
+            pendingSettings[U_HUM_FULL] = intToStr(DewAutomationN[DA_FULL].value);
+            DewAutomationNP.s = IPS_BUSY;
+            IDSetNumber(&DewAutomationNP, nullptr);
+            return true;
+        }
+
         // SQM calibration
         if (!strcmp(name, SQMOffsetNP.name))
         {
@@ -217,35 +578,125 @@ bool AstroLink4micro::ISNewNumber(const char *dev, const char *name, double valu
             IUUpdateNumber(&SQMOffsetNP, values, names, n);
             SQMOffsetNP.s = IPS_OK;
             IDSetNumber(&SQMOffsetNP, nullptr);
+            publishSQM(true);
             return true;
         }            
+        if (!strcmp(name, SQMIntegrationSettingsNP.name))
+        {
+            IUUpdateNumber(&SQMIntegrationSettingsNP, values, names, n);
+            sqmAverager.configure(SQMIntegrationSettingsN[SQMS_TARGET].value, SQMIntegrationSettingsN[SQMS_MAX_SAMPLES].value);
+            SQMIntegrationSettingsNP.s = IPS_OK;
+            IDSetNumber(&SQMIntegrationSettingsNP, nullptr);
+            return true;
+        }
+
+        // Weather safety settings
+        if (!strcmp(name, WeatherSafetyNP.name))
+        {
+            double window = WeatherSafetyN[WS_WINDOW].value;
+            IUUpdateNumber(&WeatherSafetyNP, values, names, n);
+            if (WeatherSafetyN[WS_WINDOW].value != window)
+            {
+                skyDiffStats.setWindow(WeatherSafetyN[WS_WINDOW].value * 60.0);
+                humidityStats.setWindow(WeatherSafetyN[WS_WINDOW].value * 60.0);
+                dewMarginStats.setWindow(WeatherSafetyN[WS_WINDOW].value * 60.0);
+                sqmStats.setWindow(WeatherSafetyN[WS_WINDOW].value * 60.0);
+            }
+            WeatherSafetyNP.s = IPS_OK;
+            IDSetNumber(&WeatherSafetyNP, nullptr);
+            return true;
+        }
           
-        // Focuser settings
+        // Focuser settings, written with the next poll
         if (!strcmp(name, Focuser1SettingsNP.name))
         {
-            bool allOk = true;
-            std::map<int, std::string> updates;
-            updates[U_FOC1_STEP] = doubleToStr(values[FS1_STEP_SIZE] * 100.0);
-            updates[U_FOC1_COMPSTEPS] = doubleToStr(values[FS1_COMPENSATION] * 100.0);
-            updates[U_FOC1_COMPTRIGGER] = doubleToStr(values[FS1_COMP_THRESHOLD]);
-            updates[U_FOC1_SPEED] = intToStr(values[FS1_SPEED]);
-            updates[U_FOC1_ACC] = intToStr(values[FS1_SPEED] * 5.0);
-            updates[U_FOC1_CUR] = intToStr(values[FS1_CURRENT] / 10.0);
-            updates[U_FOC1_HOLD] = intToStr(values[FS1_HOLD]);
-            allOk = allOk && updateSettings("u", "U", updates);
-            updates.clear();
-            if (allOk)
+            queueFocuserSettings(0, values);
+            Focuser1SettingsNP.s = IPS_BUSY;
+            IUUpdateNumber(&Focuser1SettingsNP, values, names, n);
+            IDSetNumber(&Focuser1SettingsNP, nullptr);
+            DEBUGF(INDI::Logger::DBG_SESSION, "Focuser temperature compensation is %s", (values[FS1_COMPENSATION] > 0) ? "enabled" : "disabled");
+            return true;
+        }        
+        if (!strcmp(name, Focuser2SettingsNP.name))
+        {
+            queueFocuserSettings(1, values);
+            Focuser2SettingsNP.s = IPS_BUSY;
+            IUUpdateNumber(&Focuser2SettingsNP, values, names, n);
+            IDSetNumber(&Focuser2SettingsNP, nullptr);
+            DEBUGF(INDI::Logger::DBG_SESSION, "Focuser 2 temperature compensation is %s", (values[FS1_COMPENSATION] > 0) ? "enabled" : "disabled");
+            return true;
+        }
+
+        // Interpolated position rate
+        if (!strcmp(name, FocusInterpolationNP.name))
+        {
+            IUUpdateNumber(&FocusInterpolationNP, values, names, n);
+            FocusInterpolationNP.s = IPS_OK;
+            IDSetNumber(&FocusInterpolationNP, nullptr);
+            if (isConnected())
+                startInterpolationTimer();
+            return true;
+        }
+
+        // Temperature model settings
+        if (!strcmp(name, FocusModelSettingsNP.name))
+        {
+            IUUpdateNumber(&FocusModelSettingsNP, values, names, n);
+            focusModel.setForgetting(FocusModelSettingsN[FMSET_FORGETTING].value);
+            FocusModelSettingsNP.s = IPS_OK;
+            IDSetNumber(&FocusModelSettingsNP, nullptr);
+            return true;
+        }
+
+        // Focuser 2 motion
+        if (!strcmp(name, Focuser2AbsPosNP.name))
+        {
+            Focuser2AbsPosNP.s = moveFocuser2(static_cast<uint32_t>(values[0]));
+            IDSetNumber(&Focuser2AbsPosNP, nullptr);
+            return true;
+        }
+        if (!strcmp(name, Focuser2RelPosNP.name))
+        {
+            IUUpdateNumber(&Focuser2RelPosNP, values, names, n);
+            double target = Focuser2AbsPosN[0].value + ((Focuser2MotionS[F2_INWARD].s == ISS_ON) ? -values[0] : values[0]);
+            Focuser2RelPosNP.s = moveFocuser2(static_cast<uint32_t>(std::max(0.0, target)));
+            IDSetNumber(&Focuser2RelPosNP, nullptr);
+            return true;
+        }
+        if (!strcmp(name, Focuser2SyncNP.name))
+        {
+            snprintf(cmd, ASTROLINK4_LEN, "P:%i:%u", 1, static_cast<uint32_t>(values[0]));
+            if (sendCommand(cmd, res))
             {
-                Focuser1SettingsNP.s = IPS_BUSY;
-                IUUpdateNumber(&Focuser1SettingsNP, values, names, n);
-                IDSetNumber(&Focuser1SettingsNP, nullptr);
-                DEBUGF(INDI::Logger::DBG_SESSION, "Focuser temperature compensation is %s", (values[FS1_COMPENSATION] > 0) ? "enabled" : "disabled");
-                return true;
+                IUUpdateNumber(&Focuser2SyncNP, values, names, n);
+                Focuser2SyncNP.s = IPS_OK;
+                Focuser2AbsPosNP.s = IPS_BUSY;
             }
-            Focuser1SettingsNP.s = IPS_ALERT;
+            else
+                Focuser2SyncNP.s = IPS_ALERT;
+            IDSetNumber(&Focuser2SyncNP, nullptr);
             return true;
-        }        
-        
+        }
+        // Protection thresholds, written with the next poll
+        if (!strcmp(name, ProtectionSettingsNP.name))
+        {
+            IUUpdateNumber(&ProtectionSettingsNP, values, names, n);
+            pendingSettings[U_OVERVOLTAGE] = doubleToStr(ProtectionSettingsN[PS_OVERVOLTAGE].value);
+            pendingSettings[U_OVERCURRENT] = doubleToStr(ProtectionSettingsN[PS_OVERCURRENT].value);
+            pendingSettings[U_OVERTIME] = doubleToStr(ProtectionSettingsN[PS_OVERTIME].value);
+            ProtectionSettingsNP.s = IPS_BUSY;
+            IDSetNumber(&ProtectionSettingsNP, nullptr);
+            return true;
+        }
+        if (!strcmp(name, Focuser2MaxPosNP.name))
+        {
+            pendingSettings[U_FOC2_MAX] = intToStr(values[0]);
+            IUUpdateNumber(&Focuser2MaxPosNP, values, names, n);
+            Focuser2MaxPosNP.s = IPS_BUSY;
+            IDSetNumber(&Focuser2MaxPosNP, nullptr);
+            return true;
+        }
+
         if (strstr(name, "FOCUS_"))
             return FI::processNumber(dev, name, values, names, n);
         if (strstr(name, "WEATHER_"))
@@ -276,6 +727,22 @@ bool AstroLink4micro::ISNewText(const char *dev, const char *name, char *texts[]
 
 			return true;
 		}
+		// flight recorder dump directory
+		if (!strcmp(name, FlightRecorderDirTP.name))
+		{
+			IUUpdateText(&FlightRecorderDirTP, texts, names, n);
+			FlightRecorderDirTP.s = IPS_OK;
+			IDSetText(&FlightRecorderDirTP, nullptr);
+			return true;
+		}
+		// capture file, used when the capture is started next time
+		if (!strcmp(name, CaptureFileTP.name))
+		{
+			IUUpdateText(&CaptureFileTP, texts, names, n);
+			CaptureFileTP.s = IPS_OK;
+			IDSetText(&CaptureFileTP, nullptr);
+			return true;
+		}
 	}
 
 	return INDI::DefaultDevice::ISNewText(dev, name, texts, names, n);
@@ -288,12 +755,90 @@ bool AstroLink4micro::ISNewSwitch(const char *dev, const char *name, ISState *st
 	{
         char cmd[ASTROLINK4_LEN] = {0};
         char res[ASTROLINK4_LEN] = {0};
+
+		// flight recorder dump on request
+		if (!strcmp(name, FlightRecorderDumpSP.name))
+		{
+            FlightRecorderDumpS[0].s = ISS_OFF;
+            FlightRecorderDumpSP.s = dumpFlightRecorder("request") ? IPS_OK : IPS_ALERT;
+            IDSetSwitch(&FlightRecorderDumpSP, nullptr);
+            return true;
+		}
+		// power profiling, a new profile starts with a sampling burst
+		if (!strcmp(name, PowerProfileSP.name))
+		{
+            IUUpdateSwitch(&PowerProfileSP, states, names, n);
+            double now = monotonicSeconds();
+            loadStep.active = false;
+            if (PowerProfileS[PP_ON].s == ISS_ON)
+            {
+                profileStart = now;
+                profileBurstUntil = now + PowerProfileSettingsN[PPS_BURST].value;
+                lastPowerSample = 0;
+                PowerProfileN[PPD_DURATION].value = PowerProfileN[PPD_ENERGY].value = PowerProfileN[PPD_CHARGE].value = 0;
+                PowerProfileN[PPD_POWER].value = PowerProfileN[PPD_PEAK].value = 0;
+                PowerProfileSP.s = IPS_BUSY;
+                DEBUG(INDI::Logger::DBG_SESSION, "Power profiling started");
+            }
+            else
+            {
+                profileBurstUntil = 0;
+                PowerProfileSP.s = IPS_IDLE;
+                publishPowerProfile();
+                DEBUGF(INDI::Logger::DBG_SESSION, "Power profiling stopped, %.2f Wh in %.2f h", PowerProfileN[PPD_ENERGY].value, PowerProfileN[PPD_DURATION].value);
+            }
+            IDSetSwitch(&PowerProfileSP, nullptr);
+            return true;
+		}
+		// dew control per output, the integrator starts from zero when enabled
+		if (!strcmp(name, DewControlSP.name))
+		{
+            bool wasOn[2] = { DewControlS[DEW_PWM1].s == ISS_ON, DewControlS[DEW_PWM2].s == ISS_ON };
+            IUUpdateSwitch(&DewControlSP, states, names, n);
+            for (int channel = 0; channel < 2; channel++)
+                if (!wasOn[channel] && DewControlS[channel].s == ISS_ON)
+                    dewIntegral[channel] = 0;
+            lastDewControl = 0;
+            DewControlSP.s = IPS_OK;
+            IDSetSwitch(&DewControlSP, nullptr);
+            return true;
+		}
+		// serial capture
+		if (!strcmp(name, SerialCaptureSP.name))
+		{
+            IUUpdateSwitch(&SerialCaptureSP, states, names, n);
+            if (SerialCaptureS[CAP_ON].s == ISS_ON)
+            {
+                if (captureWriter.open(CaptureFileT[0].text))
+                {
+                    SerialCaptureSP.s = IPS_BUSY;
+                    DEBUGF(INDI::Logger::DBG_SESSION, "Serial capture started, recording to %s", CaptureFileT[0].text);
+                }
+                else
+                {
+                    SerialCaptureS[CAP_ON].s = ISS_OFF;
+                    SerialCaptureS[CAP_OFF].s = ISS_ON;
+                    SerialCaptureSP.s = IPS_ALERT;
+                    DEBUGF(INDI::Logger::DBG_ERROR, "Cannot open capture file %s", CaptureFileT[0].text);
+                }
+            }
+            else
+            {
+                captureWriter.close();
+                SerialCaptureSP.s = IPS_IDLE;
+                DEBUG(INDI::Logger::DBG_SESSION, "Serial capture stopped");
+            }
+            IDSetSwitch(&SerialCaptureSP, nullptr);
+            return true;
+		}
         
 		// handle relay 1
 		if (!strcmp(name, Switch1SP.name))
 		{
             sprintf(cmd, "C:0:%s", (strcmp(Switch1S[S1_ON].name, names[0])) ? "0" : "1");
             bool allOk = sendCommand(cmd, res);
+            if (allOk)
+                noteOutputChange(OUTPUT_OUT1, (strcmp(Switch1S[S1_ON].name, names[0]) ? 0.0 : 1.0) - ((Switch1S[S1_ON].s == ISS_ON) ? 1.0 : 0.0));
             Switch1SP.s = allOk ? IPS_BUSY : IPS_ALERT;
             if (allOk)
                 IUUpdateSwitch(&Switch1SP, states, names, n);
@@ -306,6 +851,8 @@ bool AstroLink4micro::ISNewSwitch(const char *dev, const char *name, ISState *st
 		{
             sprintf(cmd, "C:1:%s", (strcmp(Switch2S[S2_ON].name, names[0])) ? "0" : "1");
             bool allOk = sendCommand(cmd, res);
+            if (allOk)
+                noteOutputChange(OUTPUT_OUT2, (strcmp(Switch2S[S2_ON].name, names[0]) ? 0.0 : 1.0) - ((Switch2S[S2_ON].s == ISS_ON) ? 1.0 : 0.0));
             Switch2SP.s = allOk ? IPS_BUSY : IPS_ALERT;
             if (allOk)
                 IUUpdateSwitch(&Switch2SP, states, names, n);
@@ -318,6 +865,8 @@ bool AstroLink4micro::ISNewSwitch(const char *dev, const char *name, ISState *st
 		{
             sprintf(cmd, "C:2:%s", (strcmp(Switch3S[S3_ON].name, names[0])) ? "0" : "1");
             bool allOk = sendCommand(cmd, res);
+            if (allOk)
+                noteOutputChange(OUTPUT_OUT3, (strcmp(Switch3S[S3_ON].name, names[0]) ? 0.0 : 1.0) - ((Switch3S[S3_ON].s == ISS_ON) ? 1.0 : 0.0));
             Switch3SP.s = allOk ? IPS_BUSY : IPS_ALERT;
             if (allOk)
                 IUUpdateSwitch(&Switch3SP, states, names, n);
@@ -326,25 +875,84 @@ bool AstroLink4micro::ISNewSwitch(const char *dev, const char *name, ISState *st
             return true;            
 		}          
         // Focuser Mode
-        if (!strcmp(name, Focuser1ModeSP.name))
+        if (!strcmp(name, Focuser1ModeSP.name) || !strcmp(name, Focuser2ModeSP.name))
         {
+            ISwitchVectorProperty *modeSP = (!strcmp(name, Focuser1ModeSP.name)) ? &Focuser1ModeSP : &Focuser2ModeSP;
+            int axis = (modeSP == &Focuser1ModeSP) ? 0 : 1;
             std::string value = "0";
-            if (!strcmp(Focuser1ModeS[FS1_MODE_UNI].name, names[0]))
+            if (!strcmp(modeSP->sp[FS1_MODE_UNI].name, names[0]))
                 value = "0";
-            if (!strcmp(Focuser1ModeS[FS1_MODE_MICRO_L].name, names[0]))
+            if (!strcmp(modeSP->sp[FS1_MODE_MICRO_L].name, names[0]))
                 value = "1";
-            if (!strcmp(Focuser1ModeS[FS1_MODE_MICRO_H].name, names[0]))
+            if (!strcmp(modeSP->sp[FS1_MODE_MICRO_H].name, names[0]))
                 value = "2";
-            if (updateSettings("u", "U", U_FOC1_MODE, value.c_str()))
+            pendingSettings[U_FOC1_MODE + axis] = value;
+            modeSP->s = IPS_BUSY;
+            IUUpdateSwitch(modeSP, states, names, n);
+            IDSetSwitch(modeSP, nullptr);
+            return true;
+        }                   
+        // Temperature model
+        if (!strcmp(name, FocusModelSP.name))
+        {
+            IUUpdateSwitch(&FocusModelSP, states, names, n);
+            if (FocusModelS[FM_RECORD].s == ISS_ON)
+                recordFocusPoint();
+            else if (FocusModelS[FM_APPLY].s == ISS_ON)
+                applyFocusModel();
+            else if (FocusModelS[FM_RESET].s == ISS_ON)
             {
-                Focuser1ModeSP.s = IPS_BUSY;
-                IUUpdateSwitch(&Focuser1ModeSP, states, names, n);
-                IDSetSwitch(&Focuser1ModeSP, nullptr);
-                return true;
+                focusModel.reset();
+                FocusModelSP.s = IPS_IDLE;
+                DEBUG(INDI::Logger::DBG_SESSION, "Temperature model reset");
             }
-            Focuser1ModeSP.s = IPS_ALERT;
+            IUResetSwitch(&FocusModelSP);
+            IDSetSwitch(&FocusModelSP, nullptr);
+            publishFocusModel();
             return true;
-        }                   
+        }
+        if (!strcmp(name, FocusApproachSP.name))
+        {
+            IUUpdateSwitch(&FocusApproachSP, states, names, n);
+            FocusApproachSP.s = IPS_OK;
+            IDSetSwitch(&FocusApproachSP, nullptr);
+            return true;
+        }
+        if (!strcmp(name, FocusModelSourceSP.name))
+        {
+            int previous = IUFindOnSwitchIndex(&FocusModelSourceSP);
+            IUUpdateSwitch(&FocusModelSourceSP, states, names, n);
+            // points against another sensor do not fit the same line
+            if (IUFindOnSwitchIndex(&FocusModelSourceSP) != previous)
+                focusModel.reset();
+            FocusModelSourceSP.s = IPS_OK;
+            IDSetSwitch(&FocusModelSourceSP, nullptr);
+            publishFocusModel();
+            return true;
+        }
+        // Focuser 2 reverse and abort
+        if (!strcmp(name, Focuser2ReverseSP.name))
+        {
+            IUUpdateSwitch(&Focuser2ReverseSP, states, names, n);
+            pendingSettings[U_FOC2_REV] = (Focuser2ReverseS[F2_REVERSE_ENABLED].s == ISS_ON) ? "1" : "0";
+            Focuser2ReverseSP.s = IPS_BUSY;
+            IDSetSwitch(&Focuser2ReverseSP, nullptr);
+            return true;
+        }
+        if (!strcmp(name, Focuser2MotionSP.name))
+        {
+            IUUpdateSwitch(&Focuser2MotionSP, states, names, n);
+            Focuser2MotionSP.s = IPS_OK;
+            IDSetSwitch(&Focuser2MotionSP, nullptr);
+            return true;
+        }
+        if (!strcmp(name, Focuser2AbortSP.name))
+        {
+            Focuser2AbortS[0].s = ISS_OFF;
+            Focuser2AbortSP.s = stopFocuser2();
+            IDSetSwitch(&Focuser2AbortSP, nullptr);
+            return true;
+        }
         if (strstr(name, "FOCUS_")) 
             return FI::processSwitch(dev, name, states, names, n);
         if (strstr(name, "WEATHER_")) 
@@ -368,7 +976,13 @@ bool AstroLink4micro::updateSettings(const char *getCom, const char *setCom, std
     {
         std::string concatSettings = "";
         std::vector<std::string> result = split(res, ":");
-        if (result.size() >= values.size())
+        // a reply without the full layout is not written back, the same as the u readback in readDevice()
+        if (result.size() <= U_COMPSENSOR)
+        {
+            flightRecorder.record(TRACE_PARSE_ERROR, result.size(), "short u frame");
+            DEBUGF(INDI::Logger::DBG_ERROR, "Settings not written, the %s reply has %zu fields", getCom, result.size());
+        }
+        else
         {
             result[0] = setCom;
             for (std::map<int, std::string>::iterator it = values.begin(); it != values.end(); ++it)
@@ -384,6 +998,93 @@ bool AstroLink4micro::updateSettings(const char *getCom, const char *setCom, std
     }
     return false;
 }
+// all queued settings of both focuser axes and the device go out in a single U command
+bool AstroLink4micro::flushSettings()
+{
+    if (pendingSettings.empty())
+        return true;
+    bool allOk = updateSettings("u", "U", pendingSettings);
+    if (!allOk)
+        for (const auto &setting : pendingSettings)
+            if (settingsGroup(setting.first) >= 0)
+                failedSettings[settingsGroup(setting.first)] = true;
+    pendingSettings.clear();
+    if (!allOk)
+    {
+        DEBUG(INDI::Logger::DBG_ERROR, "Settings update failed, device values restored");
+        flightRecorder.record(TRACE_EVENT, 0, "settings update failed");
+        flightRecorderErrorPending = true;
+    }
+    return allOk;
+}
+
+// property owning a u/U field, -1 for fields no property shows
+int AstroLink4micro::settingsGroup(int index)
+{
+    switch (index)
+    {
+        case U_FOC1_CUR: case U_FOC1_HOLD: case U_FOC1_SPEED: case U_FOC1_ACC:
+        case U_FOC1_STEP: case U_FOC1_COMPSTEPS: case U_FOC1_COMPTRIGGER:
+            return SG_FOCUSER1;
+        case U_FOC2_CUR: case U_FOC2_HOLD: case U_FOC2_SPEED: case U_FOC2_ACC:
+        case U_FOC2_STEP: case U_FOC2_COMPSTEPS: case U_FOC2_COMPTRIGGER:
+            return SG_FOCUSER2;
+        case U_FOC1_MODE:
+            return SG_MODE1;
+        case U_FOC2_MODE:
+            return SG_MODE2;
+        case U_FOC1_MAX:
+            return SG_MAX1;
+        case U_FOC2_MAX:
+            return SG_MAX2;
+        case U_FOC1_REV:
+            return SG_REVERSE1;
+        case U_FOC2_REV:
+            return SG_REVERSE2;
+        case U_OVERVOLTAGE: case U_OVERCURRENT: case U_OVERTIME:
+            return SG_PROTECTION;
+        case U_HUM_START: case U_HUM_FULL:
+            return SG_DEW_AUTOMATION;
+        default:
+            return -1;
+    }
+}
+
+// queued or failed writes are read back from the device with the next poll
+bool AstroLink4micro::readbackPending(int group, IPState state)
+{
+    return failedSettings[group] || state == IPS_BUSY || state == IPS_IDLE;
+}
+
+// device values are restored either way, a failed write leaves the property in alert
+IPState AstroLink4micro::readbackState(int group)
+{
+    IPState state = failedSettings[group] ? IPS_ALERT : IPS_OK;
+    failedSettings[group] = false;
+    return state;
+}
+
+void AstroLink4micro::queueFocuserSettings(int axis, const double values[])
+{
+    pendingSettings[U_FOC1_STEP + axis] = doubleToStr(values[FS1_STEP_SIZE] * 100.0);
+    pendingSettings[U_FOC1_COMPSTEPS + axis] = doubleToStr(values[FS1_COMPENSATION] * 100.0);
+    pendingSettings[U_FOC1_COMPTRIGGER + axis] = doubleToStr(values[FS1_COMP_THRESHOLD]);
+    pendingSettings[U_FOC1_SPEED + axis] = intToStr(values[FS1_SPEED]);
+    pendingSettings[U_FOC1_ACC + axis] = intToStr(values[FS1_SPEED] * 5.0);
+    pendingSettings[U_FOC1_CUR + axis] = intToStr(values[FS1_CURRENT] / 10.0);
+    pendingSettings[U_FOC1_HOLD + axis] = intToStr(values[FS1_HOLD]);
+}
+
+void AstroLink4micro::readFocuserSettings(int axis, const std::vector<std::string> &result, INumber *settings)
+{
+    settings[FS1_STEP_SIZE].value = std::stod(result[U_FOC1_STEP + axis]) / 100.0;
+    settings[FS1_COMPENSATION].value = std::stod(result[U_FOC1_COMPSTEPS + axis]) / 100.0;
+    settings[FS1_COMP_THRESHOLD].value = std::stod(result[U_FOC1_COMPTRIGGER + axis]);
+    settings[FS1_SPEED].value = std::stod(result[U_FOC1_SPEED + axis]);
+    settings[FS1_CURRENT].value = std::stod(result[U_FOC1_CUR + axis]) * 10.0;
+    settings[FS1_HOLD].value = std::stod(result[U_FOC1_HOLD + axis]);
+}
+
 /**************************************************************************************
 ** Client is asking us to establish connection to the device
 ***************************************************************************************/
@@ -414,11 +1115,45 @@ void AstroLink4micro::TimerHit()
 {
 	if (!isConnected()) 
     {
+        // a dump requested while disconnected still holds the last session
+        if (flightRecorderSignalPending.exchange(false))
+            dumpFlightRecorder("signal");
         SetTimer(POLL_PERIOD);
 		return;
     }
-    readDevice();
-    SetTimer(POLL_PERIOD);
+    flushSettings();
+    try
+    {
+        readDevice();
+    }
+    catch (const std::exception &e)
+    {
+        flightRecorder.record(TRACE_PARSE_ERROR, 0, e.what());
+        DEBUGF(INDI::Logger::DBG_ERROR, "Cannot parse device reply: %s", e.what());
+        flightRecorderErrorPending = true;
+    }
+
+    // dumps run here, outside of the signal handler and the serial exchange
+    if (flightRecorderSignalPending.exchange(false))
+        dumpFlightRecorder("signal");
+    // a persistent fault (cable out, short frames) fails every poll and is dumped only once
+    if (!flightRecorderErrorPending)
+        flightRecorderErrorArmed = true;
+    else if (flightRecorderErrorArmed && monotonicSeconds() - lastFlightRecorderDump > FLIGHT_RECORDER_DUMP_INTERVAL)
+    {
+        dumpFlightRecorder("error");
+        flightRecorderErrorArmed = false;
+    }
+    flightRecorderErrorPending = false;
+
+    if (++diagnosticsCounter >= DIAGNOSTICS_POLLS)
+    {
+        diagnosticsCounter = 0;
+        updateSerialDiagnostics();
+        if (focusModel.count() > 0)
+            publishFocusModel();
+    }
+    SetTimer(pollPeriod());
 }
 
 
@@ -429,57 +1164,114 @@ bool AstroLink4micro::readDevice()
     {
         std::vector<std::string> result = split(res, ":");
         result.erase(result.begin());
+        if (result.size() <= Q_FOC2_TO_GO)
+            throw std::out_of_range("short q frame");
 
-        int focuserPosition = std::stoi(result[Q_FOC1_POS]);
+        int polledPosition = std::stoi(result[Q_FOC1_POS]);
         int stepsToGo = std::stoi(result[Q_FOC1_TO_GO]);
-        
-        FocusAbsPosNP[0].setValue(focuserPosition);
-        if (stepsToGo == 0)
+        // re-anchors the member focuserPosition that startFocuserLeg() reads below
+        correctFocuserEstimate(polledPosition, stepsToGo != 0);
+        // a failed final leg stays in alert until the next move, a stopped focuser is not a finished one
+        IPState focuserState = (stepsToGo != 0) ? IPS_BUSY : (backlashLegFailed ? IPS_ALERT : IPS_OK);
+        // the overshoot is reached, start the final leg of the backlash move
+        if (stepsToGo == 0 && backlashTarget >= 0)
         {
-            FocusAbsPosNP.setState(IPS_OK);
-            FocusRelPosNP.setState(IPS_OK);
-        }
-        else
-        {
-            FocusAbsPosNP.setState(IPS_BUSY);
-            FocusRelPosNP.setState(IPS_BUSY);
+            uint32_t target = backlashTarget;
+            backlashTarget = -1;
+            focuserState = startFocuserLeg(target);
+            // the focuser is left at the overshoot, not at the target
+            backlashLegFailed = (focuserState == IPS_ALERT);
+            if (backlashLegFailed)
+                DEBUGF(INDI::Logger::DBG_ERROR, "Cannot start the final backlash leg to %u", target);
         }
+        FocusAbsPosNP[0].setValue(polledPosition);
+        if (focuserState != FocusAbsPosNP.getState())
+            traceState("FOCUS_ABS_POSITION", focuserState);
+        FocusAbsPosNP.setState(focuserState);
+        FocusRelPosNP.setState(focuserState);
         FocusAbsPosNP.apply();
         FocusRelPosNP.apply();
 
-        if (result.size() > 5)
+        // second axis comes in the same frame
+        Focuser2AbsPosN[0].value = std::stoi(result[Q_FOC2_POS]);
+        focuser2FrameTime = monotonicSeconds();
+        IPState focuser2State = (std::stoi(result[Q_FOC2_TO_GO]) == 0) ? IPS_OK : IPS_BUSY;
+        if ((focuser2State == IPS_BUSY) != (Focuser2AbsPosNP.s == IPS_BUSY))
+            traceState("FOCUS2_ABS_POSITION", focuser2State);
+        Focuser2AbsPosNP.s = Focuser2RelPosNP.s = focuser2State;
+        IDSetNumber(&Focuser2AbsPosNP, nullptr);
+        IDSetNumber(&Focuser2RelPosNP, nullptr);
+
+        if (result.size() > Q_SBM)
         {
-            if (std::stoi(result[Q_SENS1_PRESENT]) > 0)
+            double now = monotonicSeconds();
+            lastWeatherSample = now;
+            bool externalPresent = std::stoi(result[Q_SENS2E_PRESENT]) > 0;
+            bool skyPresent = std::stoi(result[Q_MLX_PRESENT]) > 0;
+            updateSensorPresence(SENSOR_1, std::stoi(result[Q_SENS1_PRESENT]) > 0);
+            updateSensorPresence(SENSOR_2, std::stoi(result[Q_SENS2_PRESENT]) > 0);
+            updateSensorPresence(SENSOR_EXT, externalPresent);
+            updateSensorPresence(SENSOR_SKY, skyPresent);
+            updateSensorPresence(SENSOR_SQM, std::stoi(result[Q_SBM_PRESENT]) > 0);
+            defineWeatherParameters();
+
+            // absent sensors are not parsed
+            if (sensorDefined[SENSOR_1])
             {
-                setParameterValue("WEATHER_TEMPERATURE", std::stod(result[Q_SENS1_TEMP]));
-                setParameterValue("WEATHER_HUMIDITY", std::stod(result[Q_SENS1_HUM]));
-                setParameterValue("WEATHER_DEWPOINT", std::stod(result[Q_SENS1_DEW]));
+                Sensor1N[SENS_TEMP].value = std::stod(result[Q_SENS1_TEMP]);
+                Sensor1N[SENS_HUM].value = std::stod(result[Q_SENS1_HUM]);
+                Sensor1N[SENS_DEW].value = std::stod(result[Q_SENS1_DEW]);
+                Sensor1NP.s = IPS_OK;
+                IDSetNumber(&Sensor1NP, nullptr);
             }
-            else
+            if (sensorDefined[SENSOR_2])
             {
-                setParameterValue("WEATHER_TEMPERATURE", 0.0);
-                setParameterValue("WEATHER_HUMIDITY", 0.0);
-                setParameterValue("WEATHER_DEWPOINT", 0.0);
-                
+                Sensor2N[SENS_TEMP].value = std::stod(result[Q_SENS2_TEMP]);
+                Sensor2NP.s = IPS_OK;
+                IDSetNumber(&Sensor2NP, nullptr);
             }
-            if (std::stoi(result[Q_MLX_PRESENT]) > 0)
+            if (externalPresent)
             {
-                setParameterValue("WEATHER_SKY_TEMP", std::stod(result[Q_MLX_TEMP]));
-                setParameterValue("WEATHER_SKY_DIFF", std::stod(result[Q_MLX_TEMP]) - std::stod(result[Q_MLX_AUX]));     
+                SensorExtN[SENS_TEMP].value = std::stod(result[Q_SENS2E_TEMP]);
+                SensorExtN[SENS_HUM].value = std::stod(result[Q_SENS2E_HUM]);
+                SensorExtN[SENS_DEW].value = std::stod(result[Q_SENS2E_DEW]);
+                SensorExtNP.s = IPS_OK;
+                IDSetNumber(&SensorExtNP, nullptr);
             }
-            else
+
+            INumber *ambient = ambientSensor();
+            if (ambient)
             {
-                setParameterValue("WEATHER_SKY_TEMP", 0.0);
-                setParameterValue("WEATHER_SKY_DIFF", 0.0);              
+                if (weatherParameters[WP_AMBIENT])
+                {
+                    setParameterValue("WEATHER_TEMPERATURE", ambient[SENS_TEMP].value);
+                    setParameterValue("WEATHER_HUMIDITY", ambient[SENS_HUM].value);
+                    setParameterValue("WEATHER_DEWPOINT", ambient[SENS_DEW].value);
+                }
+                humidityStats.add(now, ambient[SENS_HUM].value);
+                dewMarginStats.add(now, ambient[SENS_TEMP].value - ambient[SENS_DEW].value);
             }
-            if (std::stoi(result[Q_SBM_PRESENT]) > 0)
+            if (skyPresent)
             {
-                setParameterValue("SQM_READING", std::stod(result[Q_SBM]) + SQMOffsetN[0].value);
+                SkySensorN[SKY_TEMP].value = std::stod(result[Q_MLX_TEMP]);
+                SkySensorN[SKY_AMBIENT].value = std::stod(result[Q_MLX_AUX]);
+                SkySensorN[SKY_DIFF].value = SkySensorN[SKY_TEMP].value - SkySensorN[SKY_AMBIENT].value;
+                SkySensorNP.s = IPS_OK;
+                IDSetNumber(&SkySensorNP, nullptr);
+                if (weatherParameters[WP_SKY])
+                {
+                    setParameterValue("WEATHER_SKY_TEMP", SkySensorN[SKY_TEMP].value);
+                    setParameterValue("WEATHER_SKY_DIFF", SkySensorN[SKY_DIFF].value);
+                }
+                skyDiffStats.add(now, SkySensorN[SKY_DIFF].value);
             }
-            else
+            if (sensorDefined[SENSOR_SQM])
             {
-                setParameterValue("SQM_READING", 0.0);
+                sqmAverager.add(std::stod(result[Q_SBM]));
+                sqmStats.add(now, std::stod(result[Q_SBM]) + SQMOffsetN[0].value);
+                publishSQM(false);
             }
+            updateWeatherSafety();
 
             if (Switch1SP.s != IPS_OK || Switch2SP.s != IPS_OK || Switch3SP.s != IPS_OK)
             {
@@ -498,140 +1290,1012 @@ bool AstroLink4micro::readDevice()
             }
 
             PWM1N[0].value = std::stod(result[Q_PWM1]);
-            PWM2N[1].value = std::stod(result[Q_PWM2]);
+            PWM2N[0].value = std::stod(result[Q_PWM2]);
             PWM1NP.s = IPS_OK;
             IDSetNumber(&PWM1NP, nullptr);
             PWM2NP.s = IPS_OK;
             IDSetNumber(&PWM2NP, nullptr);
 
+            // heater energy from the reported duty, whoever set it
+            if (lastHeaterSample > 0 && now - lastHeaterSample < WEATHER_STALE_TIME)
+            {
+                double hours = (now - lastHeaterSample) / 3600.0;
+                DewStateN[DST_ENERGY1].value += PWM1N[0].value / 100.0 * DewSettingsN[DS_POWER1].value * hours;
+                DewStateN[DST_ENERGY2].value += PWM2N[0].value / 100.0 * DewSettingsN[DS_POWER2].value * hours;
+            }
+            lastHeaterSample = now;
+            updateDewControl(now);
+
             PowerDataN[POW_ITOT].value = std::stod(result[Q_ITOT]);
             PowerDataN[POW_VIN].value = std::stod(result[Q_VIN]);
             PowerDataN[POW_AH].value = std::stod(result[Q_AH]);
             PowerDataN[POW_WH].value = std::stod(result[Q_WH]);
             PowerDataNP.s = IPS_OK;
             IDSetNumber(&PowerDataNP, nullptr);
+            updatePowerProfile(now, PowerDataN[POW_VIN].value, PowerDataN[POW_ITOT].value);
+
+            updateProtection(std::stoi(result[Q_OVERTYPE]), std::stod(result[Q_OVERVALUE]), PowerDataN[POW_VIN].value, PowerDataN[POW_ITOT].value);
         }
     }
     
-    // update settings data if was changed
-    if (FocusMaxPosNP.getState() != IPS_OK || FocusReverseSP.getState() != IPS_OK || Focuser1SettingsNP.s != IPS_OK || Focuser1ModeSP.s != IPS_OK)
+    // update settings data if was changed or a write failed
+    bool focuser1Changed = readbackPending(SG_MAX1, FocusMaxPosNP.getState()) || readbackPending(SG_REVERSE1, FocusReverseSP.getState()) || readbackPending(SG_FOCUSER1, Focuser1SettingsNP.s) || readbackPending(SG_MODE1, Focuser1ModeSP.s);
+    bool focuser2Changed = readbackPending(SG_MAX2, Focuser2MaxPosNP.s) || readbackPending(SG_REVERSE2, Focuser2ReverseSP.s) || readbackPending(SG_FOCUSER2, Focuser2SettingsNP.s) || readbackPending(SG_MODE2, Focuser2ModeSP.s);
+    if (focuser1Changed || focuser2Changed || readbackPending(SG_PROTECTION, ProtectionSettingsNP.s) || readbackPending(SG_DEW_AUTOMATION, DewAutomationNP.s))
     {
         if (sendCommand("u", res))
         {
             std::vector<std::string> result = split(res, ":");
+            if (result.size() <= U_COMPSENSOR)
+                throw std::out_of_range("short u frame");
 
-            if (Focuser1SettingsNP.s != IPS_OK)
+            if (readbackPending(SG_FOCUSER1, Focuser1SettingsNP.s))
             {
 
                 DEBUGF(INDI::Logger::DBG_DEBUG, "Update settings, focuser 1, res %s", res);
-                Focuser1SettingsN[FS1_STEP_SIZE].value = std::stod(result[U_FOC1_STEP]) / 100.0;
-                Focuser1SettingsN[FS1_COMPENSATION].value = std::stod(result[U_FOC1_COMPSTEPS]) / 100.0;
-                Focuser1SettingsN[FS1_COMP_THRESHOLD].value = std::stod(result[U_FOC1_COMPTRIGGER]);
-                Focuser1SettingsN[FS1_SPEED].value = std::stod(result[U_FOC1_SPEED]);
-                Focuser1SettingsN[FS1_CURRENT].value = std::stod(result[U_FOC1_CUR]) * 10.0;
-                Focuser1SettingsN[FS1_HOLD].value = std::stod(result[U_FOC1_HOLD]);
-                Focuser1SettingsNP.s = IPS_OK;
+                readFocuserSettings(0, result, Focuser1SettingsN);
+                Focuser1SettingsNP.s = readbackState(SG_FOCUSER1);
                 IDSetNumber(&Focuser1SettingsNP, nullptr);
             }
+            if (readbackPending(SG_FOCUSER2, Focuser2SettingsNP.s))
+            {
+                DEBUGF(INDI::Logger::DBG_DEBUG, "Update settings, focuser 2, res %s", res);
+                readFocuserSettings(1, result, Focuser2SettingsN);
+                Focuser2SettingsNP.s = readbackState(SG_FOCUSER2);
+                IDSetNumber(&Focuser2SettingsNP, nullptr);
+            }
 
-            if (Focuser1ModeSP.s != IPS_OK)
+            ISwitchVectorProperty *modes[2] = { &Focuser1ModeSP, &Focuser2ModeSP };
+            for (int axis = 0; axis < 2; axis++)
             {
-                Focuser1ModeS[FS1_MODE_UNI].s = Focuser1ModeS[FS1_MODE_MICRO_L].s = Focuser1ModeS[FS1_MODE_MICRO_H].s = ISS_OFF;
-                if (!strcmp("0", result[U_FOC1_MODE].c_str()))
-                    Focuser1ModeS[FS1_MODE_UNI].s = ISS_ON;
-                if (!strcmp("1", result[U_FOC1_MODE].c_str()))
-                    Focuser1ModeS[FS1_MODE_MICRO_L].s = ISS_ON;
-                if (!strcmp("2", result[U_FOC1_MODE].c_str()))
-                    Focuser1ModeS[FS1_MODE_MICRO_H].s = ISS_ON;
-                Focuser1ModeSP.s = IPS_OK;
-                IDSetSwitch(&Focuser1ModeSP, nullptr);
+                ISwitchVectorProperty *modeSP = modes[axis];
+                if (!readbackPending(SG_MODE1 + axis, modeSP->s))
+                    continue;
+                modeSP->sp[FS1_MODE_UNI].s = modeSP->sp[FS1_MODE_MICRO_L].s = modeSP->sp[FS1_MODE_MICRO_H].s = ISS_OFF;
+                if (!strcmp("0", result[U_FOC1_MODE + axis].c_str()))
+                    modeSP->sp[FS1_MODE_UNI].s = ISS_ON;
+                if (!strcmp("1", result[U_FOC1_MODE + axis].c_str()))
+                    modeSP->sp[FS1_MODE_MICRO_L].s = ISS_ON;
+                if (!strcmp("2", result[U_FOC1_MODE + axis].c_str()))
+                    modeSP->sp[FS1_MODE_MICRO_H].s = ISS_ON;
+                modeSP->s = readbackState(SG_MODE1 + axis);
+                IDSetSwitch(modeSP, nullptr);
             }
 
-            if (FocusMaxPosNP.getState() != IPS_OK)
+            if (readbackPending(SG_MAX1, FocusMaxPosNP.getState()))
             {
                 FocusMaxPosNP[0].setValue(std::stoi(result[U_FOC1_MAX]));
-                FocusMaxPosNP.setState(IPS_OK);
+                FocusMaxPosNP.setState(readbackState(SG_MAX1));
                 FocusMaxPosNP.apply();
             }
-            if (FocusReverseSP.getState() != IPS_OK)
+            if (readbackPending(SG_REVERSE1, FocusReverseSP.getState()))
             {
                 FocusReverseSP[0].setState((std::stoi(result[U_FOC1_REV]) > 0) ? ISS_ON : ISS_OFF);
                 FocusReverseSP[1].setState((std::stoi(result[U_FOC1_REV]) == 0) ? ISS_ON : ISS_OFF);
-                FocusReverseSP.setState(IPS_OK);
+                FocusReverseSP.setState(readbackState(SG_REVERSE1));
                 FocusReverseSP.apply();
             }
+            if (readbackPending(SG_MAX2, Focuser2MaxPosNP.s))
+            {
+                Focuser2MaxPosN[0].value = std::stoi(result[U_FOC2_MAX]);
+                Focuser2AbsPosN[0].max = Focuser2SyncN[0].max = Focuser2MaxPosN[0].value;
+                Focuser2MaxPosNP.s = readbackState(SG_MAX2);
+                IDSetNumber(&Focuser2MaxPosNP, nullptr);
+            }
+            if (readbackPending(SG_REVERSE2, Focuser2ReverseSP.s))
+            {
+                Focuser2ReverseS[F2_REVERSE_ENABLED].s = (std::stoi(result[U_FOC2_REV]) > 0) ? ISS_ON : ISS_OFF;
+                Focuser2ReverseS[F2_REVERSE_DISABLED].s = (std::stoi(result[U_FOC2_REV]) == 0) ? ISS_ON : ISS_OFF;
+                Focuser2ReverseSP.s = readbackState(SG_REVERSE2);
+                IDSetSwitch(&Focuser2ReverseSP, nullptr);
+            }
+            if (readbackPending(SG_PROTECTION, ProtectionSettingsNP.s))
+            {
+                ProtectionSettingsN[PS_OVERVOLTAGE].value = std::stod(result[U_OVERVOLTAGE]);
+                ProtectionSettingsN[PS_OVERCURRENT].value = std::stod(result[U_OVERCURRENT]);
+                ProtectionSettingsN[PS_OVERTIME].value = std::stod(result[U_OVERTIME]);
+                ProtectionSettingsNP.s = readbackState(SG_PROTECTION);
+                IDSetNumber(&ProtectionSettingsNP, nullptr);
+            }
+            if (readbackPending(SG_DEW_AUTOMATION, DewAutomationNP.s))
+            {
+                DewAutomationN[DA_START].value = std::stod(result[U_HUM_START]);
+                DewAutomationN[DA_FULL].value = std::stod(result[U_HUM_FULL]);
+                DewAutomationNP.s = readbackState(SG_DEW_AUTOMATION);
+                IDSetNumber(&DewAutomationNP, nullptr);
+            }
         }
     }
         
     return true;
 }
 
+/**************************************************************************************
+** Protection events. Every change of the trip state is logged with the rail values
+** seen at that poll, and polling is sped up while the input rail is unstable so the
+** recovery is captured.
+***************************************************************************************/
+void AstroLink4micro::updateProtection(int type, double value, double vin, double itot)
+{
+    double now = monotonicSeconds();
+    bool unstable = type != 0 || (vinStats.count() > 0 && std::fabs(vin - vinStats.mean()) > VIN_DEVIATION);
+    vinStats.add(now, vin);
+    if (unstable)
+    {
+        if (fastPollUntil < now)
+            DEBUGF(INDI::Logger::DBG_DEBUG, "Power rail unstable (VIN %.2f V), fast polling", vin);
+        fastPollUntil = now + FAST_POLL_HOLD;
+    }
+
+    if (type == protectionType)
+        return;
+
+    ProtectionEvent event = { time(nullptr), type, value, vin, itot };
+    protectionEvents.push_back(event);
+    if (protectionEvents.size() > PROTECTION_LOG_SIZE)
+        protectionEvents.pop_front();
+
+    switch (type)
+    {
+        case 0:
+            DEBUGF(INDI::Logger::DBG_SESSION, "Protection cleared, VIN %.2f V, ITOT %.2f A", vin, itot);
+            break;
+        case 1:
+            DEBUGF(INDI::Logger::DBG_ERROR, "Over-voltage protection tripped at %.2f V", value);
+            break;
+        case 2:
+            DEBUGF(INDI::Logger::DBG_ERROR, "Over-current protection tripped at %.2f A", value);
+            break;
+        default:
+            DEBUGF(INDI::Logger::DBG_ERROR, "Protection type %d tripped, value %.2f", type, value);
+            break;
+    }
+    protectionType = type;
+    traceState("PROTECTION_ALARM", (type != 0) ? IPS_ALERT : IPS_OK);
+    if (type != 0)
+        flightRecorderErrorPending = true;
+
+    ProtectionL[PROT_OVERVOLTAGE].s = (type == 1) ? IPS_ALERT : IPS_OK;
+    ProtectionL[PROT_OVERCURRENT].s = (type == 2) ? IPS_ALERT : IPS_OK;
+    ProtectionLP.s = (type != 0) ? IPS_ALERT : IPS_OK;
+    IDSetLight(&ProtectionLP, nullptr);
+    publishProtectionLog();
+}
+
+void AstroLink4micro::publishProtectionLog()
+{
+    static const char *types[] = { "cleared", "over-voltage", "over-current" };
+    int i = 0;
+    for (auto it = protectionEvents.rbegin(); it != protectionEvents.rend() && i < 5; ++it, i++)
+    {
+        char timeText[32], text[MAXRBUF];
+        strftime(timeText, sizeof(timeText), "%Y-%m-%dT%H:%M:%S", localtime(&it->time));
+        const char *type = (it->type >= 0 && it->type <= 2) ? types[it->type] : "unknown";
+        snprintf(text, MAXRBUF, "%s %s value %.2f VIN %.2f V ITOT %.2f A", timeText, type, it->value, it->vin, it->itot);
+        IUSaveText(&ProtectionLogT[i], text);
+    }
+    ProtectionLogTP.s = (protectionType != 0) ? IPS_ALERT : IPS_OK;
+    IDSetText(&ProtectionLogTP, nullptr);
+}
+
+uint32_t AstroLink4micro::pollPeriod()
+{
+    // a pending backlash leg is started from the poll, poll fast to keep the pause short
+    double now = monotonicSeconds();
+    bool fast = now < fastPollUntil || now < profileBurstUntil || backlashTarget >= 0;
+    return fast ? FAST_POLL_PERIOD : POLL_PERIOD;
+}
+
+// temperature of the sensor selected as model source, false when it is not present
+bool AstroLink4micro::modelTemperature(double &temperature)
+{
+    int sensor = (IUFindOnSwitchIndex(&FocusModelSourceSP) == FMSRC_SENSOR2) ? SENSOR_2 : SENSOR_1;
+    if (!sensorDefined[sensor])
+        return false;
+    temperature = (sensor == SENSOR_2) ? Sensor2N[SENS_TEMP].value : Sensor1N[SENS_TEMP].value;
+    return true;
+}
+
+/**************************************************************************************
+** Temperature vs focus model. A point is recorded by the client after a successful
+** autofocus run, the fitted slope can be pushed to the firmware compensation.
+***************************************************************************************/
+void AstroLink4micro::recordFocusPoint()
+{
+    double temperature = 0;
+    if (!modelTemperature(temperature))
+    {
+        DEBUGF(INDI::Logger::DBG_WARNING, "Cannot record focus point, temperature sensor %d not present", IUFindOnSwitchIndex(&FocusModelSourceSP) + 1);
+        FocusModelSP.s = IPS_ALERT;
+        return;
+    }
+    if (FocusAbsPosNP.getState() == IPS_BUSY)
+    {
+        DEBUG(INDI::Logger::DBG_WARNING, "Cannot record focus point while the focuser is moving");
+        FocusModelSP.s = IPS_ALERT;
+        return;
+    }
+
+    focusModel.add(temperature, FocusAbsPosNP[0].getValue());
+    FocusModelSP.s = IPS_OK;
+    DEBUGF(INDI::Logger::DBG_SESSION, "Focus point %.0f steps at %.2f C recorded, slope %.2f steps/C", FocusAbsPosNP[0].getValue(),
+           temperature, focusModel.slope());
+
+    double autoCI = FocusModelSettingsN[FMSET_AUTO_CI].value;
+    if (autoCI > 0 && focusModel.ready() && focusModel.slopeInterval() <= autoCI)
+        applyFocusModel();
+}
+
+void AstroLink4micro::applyFocusModel()
+{
+    // with the forgetting factor, three points are not yet one degree of freedom
+    if (!focusModel.ready())
+    {
+        DEBUGF(INDI::Logger::DBG_WARNING, "Temperature model has %.2f degrees of freedom, at least 1 is needed, record more points",
+               std::max(focusModel.degreesOfFreedom(), 0.0));
+        FocusModelSP.s = IPS_ALERT;
+        return;
+    }
+    pendingSettings[U_FOC1_COMPSTEPS] = doubleToStr(focusModel.slope() * 100.0);
+    Focuser1SettingsNP.s = IPS_BUSY;
+    FocusModelSP.s = IPS_OK;
+    DEBUGF(INDI::Logger::DBG_SESSION, "Focuser compensation set to %.2f +/- %.2f steps/C", focusModel.slope(), focusModel.slopeInterval());
+}
+
+void AstroLink4micro::publishFocusModel()
+{
+    double temperature = 0;
+    bool present = modelTemperature(temperature);
+    FocusModelN[FMD_SLOPE].value = focusModel.slope();
+    // an unbounded interval is shown at the top of the range, never as a perfect fit
+    FocusModelN[FMD_CI].value = focusModel.ready() ? std::min(focusModel.slopeInterval(), FocusModelN[FMD_CI].max) : FocusModelN[FMD_CI].max;
+    FocusModelN[FMD_POINTS].value = focusModel.count();
+    FocusModelN[FMD_RESIDUAL].value = std::sqrt(focusModel.residualVariance());
+    FocusModelN[FMD_PREDICTED].value = (focusModel.count() > 0 && present) ? focusModel.predict(temperature) : 0;
+    FocusModelNP.s = focusModel.ready() ? IPS_OK : IPS_IDLE;
+    IDSetNumber(&FocusModelNP, nullptr);
+}
+
+/**************************************************************************************
+** Focuser position between polls, dead reckoned from the commanded target with the
+** trapezoidal profile the firmware uses (speed FS1_SPEED, acceleration 5 x speed) and
+** re-anchored at every q frame.
+***************************************************************************************/
+void AstroLink4micro::startFocuserEstimate(uint32_t targetTicks)
+{
+    double now = monotonicSeconds(), velocity = 0;
+    double position = focuserEstimate.active ? estimateFocuserPosition(now, &velocity) : focuserPosition;
+    focuserEstimate = { true, now, position, velocity, static_cast<double>(targetTicks) };
+}
+
+double AstroLink4micro::estimateFocuserPosition(double now, double *velocity)
+{
+    const FocuserEstimate &e = focuserEstimate;
+    double vmax = std::max(Focuser1SettingsN[FS1_SPEED].value, 1.0), accel = vmax * 5.0;
+    double direction = (e.target >= e.position) ? 1.0 : -1.0;
+    double distance = std::fabs(e.target - e.position);
+    // speed along the direction of travel, a move against it is treated as starting at rest
+    double u = std::min(std::max(e.velocity * direction, 0.0), vmax);
+    double t = std::max(now - e.time, 0.0), x, v;
+
+    if (u * u / (2.0 * accel) >= distance)
+    {
+        // already braking
+        double tStop = u / accel;
+        t = std::min(t, tStop);
+        x = std::min(u * t - accel * t * t / 2.0, distance);
+        v = u - accel * t;
+    }
+    else
+    {
+        double vPeak = std::min(vmax, std::sqrt(accel * distance + u * u / 2.0));
+        double t1 = (vPeak - u) / accel, d1 = (vPeak * vPeak - u * u) / (2.0 * accel);
+        double d3 = vPeak * vPeak / (2.0 * accel), dc = distance - d1 - d3, tc = dc / vPeak, t3 = vPeak / accel;
+        if (t < t1)
+        {
+            x = u * t + accel * t * t / 2.0;
+            v = u + accel * t;
+        }
+        else if (t < t1 + tc)
+        {
+            x = d1 + vPeak * (t - t1);
+            v = vPeak;
+        }
+        else if (t < t1 + tc + t3)
+        {
+            double tau = t - t1 - tc;
+            x = d1 + dc + vPeak * tau - accel * tau * tau / 2.0;
+            v = vPeak - accel * tau;
+        }
+        else
+        {
+            x = distance;
+            v = 0;
+        }
+    }
+    if (velocity)
+        *velocity = direction * v;
+    return e.position + direction * x;
+}
+
+void AstroLink4micro::correctFocuserEstimate(int position, bool moving)
+{
+    double now = monotonicSeconds(), velocity = 0;
+    if (focuserEstimate.active)
+    {
+        double error = position - estimateFocuserPosition(now, &velocity);
+        estimateSamples++;
+        estimateErrorMean = (estimateSamples == 1) ? std::fabs(error) : (1.0 - ESTIMATE_ERROR_ALPHA) * estimateErrorMean + ESTIMATE_ERROR_ALPHA * std::fabs(error);
+        estimateErrorMax = std::max(estimateErrorMax, std::fabs(error));
+        FocusEstimateN[FE_LAST].value = error;
+        FocusEstimateN[FE_MEAN].value = estimateErrorMean;
+        FocusEstimateN[FE_MAX].value = estimateErrorMax;
+        FocusEstimateN[FE_SAMPLES].value = estimateSamples;
+        FocusEstimateNP.s = IPS_OK;
+        IDSetNumber(&FocusEstimateNP, nullptr);
+    }
+    focuserPosition = position;
+    focuserEstimate.active = focuserEstimate.active && moving;
+    focuserEstimate.time = now;
+    focuserEstimate.position = position;
+    focuserEstimate.velocity = velocity;
+}
+
+void AstroLink4micro::publishInterpolatedPosition()
+{
+    interpolationTimerID = -1;
+    if (!isConnected() || FocusInterpolationN[0].value <= 0)
+        return;
+    if (focuserEstimate.active && FocusAbsPosNP.getState() == IPS_BUSY)
+    {
+        FocusAbsPosNP[0].setValue(std::round(estimateFocuserPosition(monotonicSeconds(), nullptr)));
+        FocusAbsPosNP.apply();
+    }
+    startInterpolationTimer();
+}
+
+void AstroLink4micro::startInterpolationTimer()
+{
+    if (interpolationTimerID >= 0 || FocusInterpolationN[0].value <= 0)
+        return;
+    interpolationTimerID = IEAddTimer(static_cast<int>(1000.0 / FocusInterpolationN[0].value), interpolationTimerHelper, this);
+}
+
+void AstroLink4micro::interpolationTimerHelper(void *context)
+{
+    static_cast<AstroLink4micro *>(context)->publishInterpolatedPosition();
+}
+
+/**************************************************************************************
+** Flight recorder
+***************************************************************************************/
+void AstroLink4micro::traceState(const char *name, IPState state)
+{
+    flightRecorder.record(TRACE_STATE, state, name);
+}
+
+bool AstroLink4micro::dumpFlightRecorder(const char *reason)
+{
+    char path[MAXRBUF], timeText[32];
+    time_t now = time(nullptr);
+    strftime(timeText, sizeof(timeText), "%Y%m%d_%H%M%S", localtime(&now));
+    snprintf(path, MAXRBUF, "%s/astrolink4micro_trace_%s.bin", FlightRecorderDirT[0].text, timeText);
+    lastFlightRecorderDump = monotonicSeconds();
+    if (!flightRecorder.dump(path))
+    {
+        DEBUGF(INDI::Logger::DBG_ERROR, "Cannot write flight recorder dump %s", path);
+        return false;
+    }
+    DEBUGF(INDI::Logger::DBG_SESSION, "Flight recorder dumped to %s (%s)", path, reason);
+    return true;
+}
+
+void AstroLink4micro::flightRecorderSignalHandler(int)
+{
+    flightRecorderSignalPending = true;
+}
+
+/**************************************************************************************
+** Sensor hot-plug
+***************************************************************************************/
+void AstroLink4micro::updateSensorPresence(int sensor, bool present)
+{
+    if (sensorDefined[sensor] == present)
+        return;
+
+    INumberVectorProperty *property = sensorProperties[sensor];
+    sensorDefined[sensor] = present;
+    traceState(property->name, present ? IPS_OK : IPS_IDLE);
+    if (present)
+    {
+        property->s = IPS_IDLE;
+        defineProperty(property);
+        if (isConnected())
+            DEBUGF(INDI::Logger::DBG_SESSION, "%s connected", property->label);
+        return;
+    }
+
+    deleteProperty(property->name);
+    if (isConnected())
+        DEBUGF(INDI::Logger::DBG_SESSION, "%s disconnected", property->label);
+    // windows of a removed sensor would mix readings from before and after the gap
+    switch (sensor)
+    {
+        case SENSOR_SKY:
+            skyDiffStats.reset();
+            cloudAlert = false;
+            break;
+        case SENSOR_SQM:
+            sqmAverager.reset();
+            sqmStats.reset();
+            break;
+        default:
+            if (!sensorDefined[SENSOR_1] && !sensorDefined[SENSOR_EXT])
+            {
+                humidityStats.reset();
+                dewMarginStats.reset();
+                dewAlert = false;
+            }
+            break;
+    }
+}
+
+// ambient readings come from sensor 1, the external sensor stands in when it is missing
+INumber *AstroLink4micro::ambientSensor()
+{
+    if (sensorDefined[SENSOR_1])
+        return Sensor1N;
+    return sensorDefined[SENSOR_EXT] ? SensorExtN : nullptr;
+}
+
+/**************************************************************************************
+** Power profiling. While a profile runs, energy and charge are integrated from VIN and
+** ITOT with the trapezoidal rule and a change of an output starts a burst of fast polls.
+** The load of the output is the ITOT step between the mean before the change and the
+** mean after the inrush has settled, scaled to the output fully on. The inrush is the
+** peak above the baseline. Battery runtime uses the firmware Ah counter and the mean
+** current of the last minute.
+***************************************************************************************/
+void AstroLink4micro::noteOutputChange(int output, double change)
+{
+    if (PowerProfileS[PP_ON].s != ISS_ON || std::fabs(change) < LOAD_MIN_CHANGE)
+        return;
+
+    double now = monotonicSeconds();
+    // an unfinished step is dropped, its window would contain both changes
+    double baseline = (currentStats.count() > 0) ? currentStats.mean() : lastItot;
+    loadStep = { true, output, change, baseline, now, 0, 0, baseline };
+    profileBurstUntil = now + PowerProfileSettingsN[PPS_BURST].value;
+}
+
+void AstroLink4micro::updatePowerProfile(double now, double vin, double itot)
+{
+    if (PowerProfileS[PP_ON].s != ISS_ON)
+        return;
+
+    if (lastPowerSample > 0 && now - lastPowerSample < WEATHER_STALE_TIME)
+    {
+        double hours = (now - lastPowerSample) / 3600.0;
+        PowerProfileN[PPD_ENERGY].value += (lastVin * lastItot + vin * itot) / 2.0 * hours;
+        PowerProfileN[PPD_CHARGE].value += (lastItot + itot) / 2.0 * hours;
+    }
+    lastPowerSample = now;
+    lastVin = vin;
+    lastItot = itot;
+    PowerProfileN[PPD_PEAK].value = std::max(PowerProfileN[PPD_PEAK].value, itot);
+    PowerProfileN[PPD_DURATION].value = (now - profileStart) / 3600.0;
+    PowerProfileN[PPD_POWER].value = (PowerProfileN[PPD_DURATION].value > 0) ? PowerProfileN[PPD_ENERGY].value / PowerProfileN[PPD_DURATION].value : vin * itot;
+    runtimeStats.add(now, itot);
+
+    if (loadStep.active)
+    {
+        double elapsed = now - loadStep.start;
+        loadStep.peak = std::max(loadStep.peak, itot);
+        if (elapsed >= LOAD_SETTLE_TIME)
+        {
+            loadStep.sum += itot;
+            loadStep.samples++;
+        }
+        if (elapsed >= LOAD_MEASURE_TIME && loadStep.samples > 0)
+        {
+            int output = loadStep.output;
+            double load = (loadStep.sum / loadStep.samples - loadStep.baseline) / loadStep.change;
+            PowerLoadN[LOAD_OUT1 + output].value = (loadSamples[output] == 0) ? load : (1.0 - LOAD_ALPHA) * PowerLoadN[LOAD_OUT1 + output].value + LOAD_ALPHA * load;
+            // inrush only shows when the output is switched on
+            if (loadStep.change > 0)
+                PowerLoadN[INRUSH_OUT1 + output].value = std::max(PowerLoadN[INRUSH_OUT1 + output].value, loadStep.peak - loadStep.baseline);
+            loadSamples[output]++;
+            loadStep.active = false;
+            PowerLoadNP.s = IPS_OK;
+            IDSetNumber(&PowerLoadNP, nullptr);
+            DEBUGF(INDI::Logger::DBG_DEBUG, "Output %d load %.2f A, peak %.2f A over %.2f A baseline", output + 1, load, loadStep.peak, loadStep.baseline);
+        }
+    }
+    // the baseline of the next step must not contain the current one
+    if (!loadStep.active)
+        currentStats.add(now, itot);
+
+    if (now - lastProfilePublish >= 1.0)
+        publishPowerProfile();
+}
+
+void AstroLink4micro::publishPowerProfile()
+{
+    double capacity = PowerProfileSettingsN[PPS_CAPACITY].value;
+    double remaining = capacity * (1.0 - PowerProfileSettingsN[PPS_RESERVE].value / 100.0) - PowerDataN[POW_AH].value;
+    double current = runtimeStats.mean();
+    PowerProfileN[PPD_RUNTIME].value = (capacity > 0 && current > 0) ? std::max(remaining, 0.0) / current : 0;
+    lastProfilePublish = monotonicSeconds();
+    PowerProfileNP.s = (PowerProfileS[PP_ON].s == ISS_ON) ? IPS_BUSY : IPS_OK;
+    IDSetNumber(&PowerProfileNP, nullptr);
+}
+
+/**************************************************************************************
+** Weather parameters follow the sensors reported by the q frames, a sensor plugged in
+** later adds its parameters. Parameters added earlier stay, the WeatherInterface cannot
+** drop them. A sensor lost during the connection forces the critical parameter that
+** depends on it to alert; one missing from the start of a connection is not monitored.
+***************************************************************************************/
+void AstroLink4micro::defineWeatherParameters()
+{
+    bool present[WP_N] = { ambientSensor() != nullptr, sensorDefined[SENSOR_SKY], sensorDefined[SENSOR_SQM] };
+    bool first = !weatherDefined;
+    for (int i = 0; i < WP_N; i++)
+        weatherMonitored[i] = weatherMonitored[i] || present[i];
+
+    std::vector<const char *> added;
+    if (present[WP_AMBIENT] && !weatherParameters[WP_AMBIENT])
+    {
+        addParameter("WEATHER_TEMPERATURE", "Temperature [C]", -15, 35, 15);
+        addParameter("WEATHER_HUMIDITY", "Humidity %", 0, 100, 15);
+        addParameter("WEATHER_DEWPOINT", "Dew Point [C]", -25, 20, 15);
+        addParameter("WEATHER_DEW", "Dew alert", 0, 0, 0);
+        setCriticalParameter("WEATHER_DEW");
+        added.insert(added.end(), { "WEATHER_TEMPERATURE", "WEATHER_HUMIDITY", "WEATHER_DEWPOINT", "WEATHER_DEW" });
+        weatherParameters[WP_AMBIENT] = true;
+    }
+    if (present[WP_SKY] && !weatherParameters[WP_SKY])
+    {
+        addParameter("WEATHER_SKY_TEMP", "Sky temperature [C]", -50, 20, 20);
+        addParameter("WEATHER_SKY_DIFF", "Temperature difference [C]", -5, 40, 10);
+        addParameter("WEATHER_CLOUDS", "Cloud alert", 0, 0, 0);
+        setCriticalParameter("WEATHER_CLOUDS");
+        added.insert(added.end(), { "WEATHER_SKY_TEMP", "WEATHER_SKY_DIFF", "WEATHER_CLOUDS" });
+        weatherParameters[WP_SKY] = true;
+    }
+    if (present[WP_SQM] && !weatherParameters[WP_SQM])
+    {
+        addParameter("SQM_READING", "Sky brightness [mag/arcsec2]", 10, 25, 15);
+        added.push_back("SQM_READING");
+        weatherParameters[WP_SQM] = true;
+    }
+
+    if (!first && added.empty())
+        return;
+
+    // a hot-plugged sensor grows the parameter vectors, clients need them defined again
+    if (!first)
+    {
+        deleteProperty("WEATHER_STATUS");
+        deleteProperty("WEATHER_PARAMETERS");
+    }
+    WI::updateProperties();
+    weatherDefined = true;
+    // ranges of parameters added now missed the config load at connect
+    for (const char *name : added)
+        loadConfig(true, name);
+
+    if (first && weatherParameters[WP_AMBIENT] && !present[WP_AMBIENT])
+        DEBUG(INDI::Logger::DBG_WARNING, "No ambient sensor, dew alert is not monitored");
+    if (first && weatherParameters[WP_SKY] && !present[WP_SKY])
+        DEBUG(INDI::Logger::DBG_WARNING, "No sky temperature sensor, cloud alert is not monitored");
+}
+
+/**************************************************************************************
+** Dew heater control. A PI loop per output holds the controlled temperature at the
+** dew point plus margin. The temperature probe of sensor 2 closes the loop; without
+** it the ambient temperature is used and the integrator is held, since the heater
+** cannot move the ambient reading. B:x:y is sent only when the demand leaves the
+** deadband or the output has to go fully off or to its maximum.
+***************************************************************************************/
+void AstroLink4micro::updateDewControl(double now)
+{
+    if (now - lastDewControl < DEW_CONTROL_PERIOD)
+        return;
+    double dt = (lastDewControl > 0) ? std::min(now - lastDewControl, 3.0 * DEW_CONTROL_PERIOD) : DEW_CONTROL_PERIOD;
+    lastDewControl = now;
+
+    INumber *ambient = ambientSensor();
+    if (!ambient)
+    {
+        DewStateNP.s = (DewControlS[DEW_PWM1].s == ISS_ON || DewControlS[DEW_PWM2].s == ISS_ON) ? IPS_ALERT : IPS_IDLE;
+        IDSetNumber(&DewStateNP, nullptr);
+        return;
+    }
+
+    bool probe = sensorDefined[SENSOR_2];
+    double target = ambient[SENS_DEW].value + DewSettingsN[DS_MARGIN].value;
+    double temperature = probe ? Sensor2N[SENS_TEMP].value : ambient[SENS_TEMP].value;
+    double error = target - temperature;
+    double maxDuty = DewSettingsN[DS_MAX].value;
+    DewStateN[DST_TARGET].value = target;
+    DewStateN[DST_TEMP].value = temperature;
+    DewStateN[DST_ERROR].value = error;
+
+    INumber *outputs[2] = { PWM1N, PWM2N };
+    bool active = false;
+    for (int channel = 0; channel < 2; channel++)
+    {
+        if (DewControlS[channel].s != ISS_ON)
+            continue;
+        active = true;
+
+        double proportional = DewSettingsN[DS_KP].value * error;
+        if (probe)
+        {
+            // integrate only while that does not push the output further into saturation
+            double integral = dewIntegral[channel] + DewSettingsN[DS_KI].value * error * dt / 60.0;
+            double demand = proportional + integral;
+            if ((demand < maxDuty || error < 0) && (demand > 0 || error > 0))
+                dewIntegral[channel] = integral;
+        }
+        double demand = std::min(std::max(proportional + (probe ? dewIntegral[channel] : 0), 0.0), maxDuty);
+        int duty = static_cast<int>(std::lround(demand));
+        int current = static_cast<int>(outputs[channel][0].value);
+        DewStateN[DST_DUTY1 + channel].value = duty;
+
+        bool edge = (duty == 0 || duty == static_cast<int>(maxDuty)) && duty != current;
+        if (std::abs(duty - current) > DewSettingsN[DS_DEADBAND].value || edge)
+            setHeaterDuty(channel, duty);
+    }
+
+    DewStateNP.s = active ? IPS_BUSY : IPS_OK;
+    IDSetNumber(&DewStateNP, nullptr);
+}
+
+bool AstroLink4micro::setHeaterDuty(int channel, int duty)
+{
+    char cmd[ASTROLINK4_LEN] = {0}, res[ASTROLINK4_LEN] = {0};
+    snprintf(cmd, ASTROLINK4_LEN, "B:%d:%d", channel, duty);
+    if (!sendCommand(cmd, res))
+        return false;
+    INumber *outputs[2] = { PWM1N, PWM2N };
+    noteOutputChange(OUTPUT_PWM1 + channel, (duty - outputs[channel][0].value) / 100.0);
+    DEBUGF(INDI::Logger::DBG_DEBUG, "Dew control PWM %d set to %d %%", channel + 1, duty);
+    return true;
+}
+
+/**************************************************************************************
+** Weather safety, evaluated from rolling window statistics updated on every poll
+***************************************************************************************/
+void AstroLink4micro::updateWeatherSafety()
+{
+    // an empty window gives no verdict, updateWeather() reports it as unknown
+    if (skyDiffStats.count() == 0)
+        cloudAlert = false;
+    else
+    {
+        double mean = skyDiffStats.mean(), stddev = skyDiffStats.stddev();
+        double limit = WeatherSafetyN[WS_CLOUD_LIMIT].value, variation = WeatherSafetyN[WS_CLOUD_VARIATION].value;
+        if (!cloudAlert && (mean > limit || stddev > variation))
+        {
+            cloudAlert = true;
+            traceState("WEATHER_CLOUDS", IPS_ALERT);
+            DEBUGF(INDI::Logger::DBG_WARNING, "Cloud alert, sky-ambient mean %.1f C, std dev %.2f C", mean, stddev);
+        }
+        // clearing needs the mean below the hysteresis band and a calm sky
+        else if (cloudAlert && mean < limit - WeatherSafetyN[WS_CLOUD_HYST].value && stddev < variation / 2.0)
+        {
+            cloudAlert = false;
+            traceState("WEATHER_CLOUDS", IPS_OK);
+            DEBUGF(INDI::Logger::DBG_SESSION, "Cloud alert cleared, sky-ambient mean %.1f C", mean);
+        }
+    }
+
+    if (dewMarginStats.count() == 0)
+        dewAlert = false;
+    else
+    {
+        // margin expected one window ahead if the current trend continues
+        double projected = dewMarginStats.last() + dewMarginStats.trend() * dewMarginStats.window();
+        double minimum = dewMarginStats.min(), humidity = humidityStats.mean();
+        double limit = WeatherSafetyN[WS_DEW_LIMIT].value, clearLimit = limit + WeatherSafetyN[WS_DEW_HYST].value;
+        if (!dewAlert && (minimum < limit || projected < limit || humidity > WeatherSafetyN[WS_HUM_LIMIT].value))
+        {
+            dewAlert = true;
+            traceState("WEATHER_DEW", IPS_ALERT);
+            DEBUGF(INDI::Logger::DBG_WARNING, "Dew alert, margin min %.1f C, projected %.1f C, humidity %.0f%%", minimum, projected, humidity);
+        }
+        else if (dewAlert && minimum > clearLimit && projected > clearLimit && humidity < WeatherSafetyN[WS_HUM_LIMIT].value - HUMIDITY_HYSTERESIS)
+        {
+            dewAlert = false;
+            traceState("WEATHER_DEW", IPS_OK);
+            DEBUGF(INDI::Logger::DBG_SESSION, "Dew alert cleared, margin min %.1f C", minimum);
+        }
+    }
+
+    WeatherStatsN[WST_SKY_MEAN].value = skyDiffStats.mean();
+    WeatherStatsN[WST_SKY_STDDEV].value = skyDiffStats.stddev();
+    WeatherStatsN[WST_SKY_TREND].value = skyDiffStats.trend() * 60.0;
+    WeatherStatsN[WST_SKY_MIN].value = skyDiffStats.min();
+    WeatherStatsN[WST_SKY_MAX].value = skyDiffStats.max();
+    WeatherStatsN[WST_HUM_MEAN].value = humidityStats.mean();
+    WeatherStatsN[WST_HUM_TREND].value = humidityStats.trend() * 60.0;
+    WeatherStatsN[WST_DEW_MEAN].value = dewMarginStats.mean();
+    WeatherStatsN[WST_DEW_MIN].value = dewMarginStats.min();
+    WeatherStatsN[WST_DEW_TREND].value = dewMarginStats.trend() * 60.0;
+    WeatherStatsN[WST_SQM_MEAN].value = sqmStats.mean();
+    WeatherStatsN[WST_SQM_STDDEV].value = sqmStats.stddev();
+    bool unknown = (weatherMonitored[WP_SKY] && skyDiffStats.count() == 0) ||
+                   (weatherMonitored[WP_AMBIENT] && dewMarginStats.count() == 0);
+    WeatherStatsNP.s = (cloudAlert || dewAlert || unknown) ? IPS_ALERT : IPS_OK;
+    IDSetNumber(&WeatherStatsNP, nullptr);
+}
+
+// averaged SQM is published only when it moves beyond its own uncertainty and the noise floor
+void AstroLink4micro::publishSQM(bool force)
+{
+    if (sqmAverager.samples() == 0)
+        return;
+
+    double value = sqmAverager.mean() + SQMOffsetN[0].value;
+    double uncertainty = sqmAverager.uncertainty();
+    double threshold = std::max(uncertainty, SQMIntegrationSettingsN[SQMS_NOISE_FLOOR].value);
+    if (!force && SQMIntegrationNP.s == IPS_OK && std::fabs(value - SQMIntegrationN[SQMI_VALUE].value) <= threshold)
+        return;
+
+    if (weatherParameters[WP_SQM])
+        setParameterValue("SQM_READING", value);
+    SQMIntegrationN[SQMI_VALUE].value = value;
+    SQMIntegrationN[SQMI_UNCERTAINTY].value = uncertainty;
+    SQMIntegrationN[SQMI_SAMPLES].value = sqmAverager.samples();
+    SQMIntegrationN[SQMI_NOISE].value = sqmAverager.noise();
+    SQMIntegrationNP.s = IPS_OK;
+    IDSetNumber(&SQMIntegrationNP, nullptr);
+}
+
+IPState AstroLink4micro::updateWeather()
+{
+    // without samples in the window, or without a q frame for a while, the sky may be anything,
+    // so the critical parameters are forced to alert. The state itself stays OK, the interface
+    // only carries the parameters over to WEATHER_STATUS on an OK update.
+    bool stale = monotonicSeconds() - lastWeatherSample > WEATHER_STALE_TIME;
+    // A sensor lost during the connection has an empty window, so only its own critical
+    // parameter goes to alert.
+    if (weatherParameters[WP_SKY])
+        setParameterValue("WEATHER_CLOUDS", (weatherMonitored[WP_SKY] && (cloudAlert || stale || skyDiffStats.count() == 0)) ? 1 : 0);
+    if (weatherParameters[WP_AMBIENT])
+        setParameterValue("WEATHER_DEW", (weatherMonitored[WP_AMBIENT] && (dewAlert || stale || dewMarginStats.count() == 0)) ? 1 : 0);
+    return IPS_OK;
+}
+
 bool AstroLink4micro::sendCommand(const char *cmd, char *res)
 {
     int nbytes_read = 0, nbytes_written = 0, tty_rc = 0;
     char command[ASTROLINK4_LEN];
+    RttEstimator &rtt = rttEstimators[commandClass(cmd[0])];
+    // only reads are repeated, a repeated move or write could act twice
+    int retries = (cmd[0] == 'q' || cmd[0] == 'u' || cmd[0] == '#') ? ASTROLINK4_RETRIES : 0;
+    // all attempts together may block the event loop no longer than one timeout at the ceiling
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(rtt.ceiling());
+    auto remaining = [&deadline]()
+    {
+        return std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+    };
     
-    tcflush(PortFD, TCIOFLUSH);
     sprintf(command, "%s\n", cmd);
-    //~ DEBUGF(INDI::Logger::DBG_SESSION, "CMD %s", cmd);
-    if ((tty_rc = tty_write_string(PortFD, command, &nbytes_written)) != TTY_OK)
-        return false;
-
-    if (!res)
+    for (int attempt = 0; ; attempt++)
     {
+        // the reply to the previous attempt may still be on its way, it is read until the line
+        // stays quiet for the class floor, a silent line costs no more than that
+        if (attempt > 0)
+            discardLateReply(std::min(rtt.floor(), remaining()));
         tcflush(PortFD, TCIOFLUSH);
-        return true;
+        flightRecorder.record(TRACE_COMMAND, attempt, cmd);
+        captureWriter.write(CAPTURE_COMMAND, cmd, strlen(cmd));
+        if ((tty_rc = tty_write_string(PortFD, command, &nbytes_written)) != TTY_OK)
+        {
+            captureWriter.write(CAPTURE_ERROR, nullptr, 0);
+            break;
+        }
+
+        if (!res)
+        {
+            tcflush(PortFD, TCIOFLUSH);
+            return true;
+        }
+
+        double timeout = std::max(std::min(rtt.timeout(), remaining()), rtt.floor());
+        auto start = std::chrono::steady_clock::now();
+        tty_rc = tty_nread_section_expanded(PortFD, res, ASTROLINK4_LEN, stopChar, static_cast<long>(timeout),
+                                            static_cast<long>((timeout - static_cast<long>(timeout)) * 1e6), &nbytes_read);
+        if (tty_rc == TTY_OK && nbytes_read > 1)
+        {
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            res[nbytes_read - 1] = '\0';
+            captureWriter.write(CAPTURE_REPLY, res, nbytes_read - 1);
+            flightRecorder.record(TRACE_REPLY, static_cast<int32_t>(elapsed * 1e6), res, nbytes_read - 1);
+            if (res[0] == cmd[0])
+            {
+                // Karn's rule, after a retry the reply may belong to an earlier attempt
+                if (attempt == 0)
+                    rtt.sample(elapsed);
+                tcflush(PortFD, TCIOFLUSH);
+                return true;
+            }
+
+            // a reply to some other command, e.g. the tail of a late one
+            flightRecorder.record(TRACE_PARSE_ERROR, 0, "unexpected reply");
+            if (attempt >= retries || remaining() < rtt.floor())
+            {
+                DEBUGF(INDI::Logger::DBG_DEBUG, "Unexpected reply %s to command %s", res, cmd);
+                return false;
+            }
+            serialRetries++;
+            continue;
+        }
+
+        captureWriter.write((tty_rc == TTY_TIME_OUT) ? CAPTURE_TIMEOUT : CAPTURE_ERROR, nullptr, 0);
+        // an empty line is a complete but invalid reply
+        if (tty_rc == TTY_OK)
+        {
+            flightRecorder.record(TRACE_PARSE_ERROR, 0, "empty reply");
+            return false;
+        }
+        if (tty_rc != TTY_TIME_OUT)
+            break;
+        serialTimeouts++;
+        flightRecorder.record(TRACE_TIMEOUT, static_cast<int32_t>(timeout * 1000.0), cmd);
+        rtt.backoff();
+        if (attempt >= retries || remaining() < rtt.floor())
+        {
+            flightRecorderErrorPending = true;
+            DEBUGF(INDI::Logger::DBG_DEBUG, "Command %s timed out after %.0f ms", cmd, timeout * 1000.0);
+            return false;
+        }
+        serialRetries++;
     }
 
-    if ((tty_rc = tty_nread_section(PortFD, res, ASTROLINK4_LEN, stopChar, ASTROLINK4_TIMEOUT, &nbytes_read)) != TTY_OK || nbytes_read == 1)
-        return false;
+    flightRecorder.record(TRACE_SERIAL_ERROR, tty_rc, cmd);
+    flightRecorderErrorPending = true;
+    char errorMessage[MAXRBUF];
+    tty_error_msg(tty_rc, errorMessage, MAXRBUF);
+    LOGF_ERROR("Serial error: %s", errorMessage);
+    return false;
+}
 
-    tcflush(PortFD, TCIOFLUSH);
-    res[nbytes_read - 1] = '\0';
-    //~ DEBUGF(INDI::Logger::DBG_SESSION, "RES %s", res);
-    if (tty_rc != TTY_OK)
+// read a late reply up to its newline, or until the line stays quiet for the timeout
+void AstroLink4micro::discardLateReply(double timeout)
+{
+    char buffer[ASTROLINK4_LEN];
+    int nbytes_read = 0;
+    tty_nread_section_expanded(PortFD, buffer, ASTROLINK4_LEN, stopChar, static_cast<long>(timeout),
+                               static_cast<long>((timeout - static_cast<long>(timeout)) * 1e6), &nbytes_read);
+    if (nbytes_read > 0)
+        flightRecorder.record(TRACE_EVENT, nbytes_read, "late reply discarded");
+}
+
+int AstroLink4micro::commandClass(char command)
+{
+    switch (command)
     {
-        char errorMessage[MAXRBUF];
-        tty_error_msg(tty_rc, errorMessage, MAXRBUF);
-        LOGF_ERROR("Serial error: %s", errorMessage);
-        return false;
+        case 'q':
+            return CMD_QUERY;
+        case 'u':
+            return CMD_SETTINGS_READ;
+        case 'U':
+            return CMD_SETTINGS_WRITE;
+        case 'R':
+        case 'P':
+        case 'H':
+            return CMD_MOTION;
+        case 'B':
+        case 'C':
+            return CMD_OUTPUT;
+        default:
+            return CMD_OTHER;
     }
-            
-    return (cmd[0] == res[0]);
+}
+
+void AstroLink4micro::updateSerialDiagnostics()
+{
+    for (int i = CMD_QUERY; i <= CMD_OUTPUT; i++)
+    {
+        SerialDiagN[SD_QUERY_RTT + 2 * i].value = rttEstimators[i].smoothed() * 1000.0;
+        SerialDiagN[SD_QUERY_RTO + 2 * i].value = rttEstimators[i].timeout() * 1000.0;
+    }
+    SerialDiagN[SD_TIMEOUTS].value = serialTimeouts;
+    SerialDiagN[SD_RETRIES].value = serialRetries;
+    SerialDiagNP.s = IPS_OK;
+    IDSetNumber(&SerialDiagNP, nullptr);
 }
 
 /**************************************************************************************
 ** Focuser interface
 ***************************************************************************************/
 IPState AstroLink4micro::MoveAbsFocuser(uint32_t targetTicks)
+{
+    backlashTarget = -1;
+    backlashLegFailed = false;
+    uint32_t backlash = (FocusBacklashSP[INDI_ENABLED].getState() == ISS_ON) ? std::abs(static_cast<int32_t>(FocusBacklashNP[0].getValue())) : 0;
+    bool outward = IUFindOnSwitchIndex(&FocusApproachSP) == APPROACH_OUTWARD;
+    bool against = outward ? (targetTicks < focuserPosition) : (targetTicks > focuserPosition);
+
+    // a move already coming from the approach side needs no overshoot
+    if (backlash == 0 || !against)
+        return startFocuserLeg(targetTicks);
+
+    uint32_t overshoot = outward ? ((targetTicks > backlash) ? targetTicks - backlash : 0)
+                         : std::min(targetTicks + backlash, static_cast<uint32_t>(FocusMaxPosNP[0].getValue()));
+    if (overshoot == targetTicks)
+        return startFocuserLeg(targetTicks);
+
+    IPState state = startFocuserLeg(overshoot);
+    if (state == IPS_BUSY)
+    {
+        backlashTarget = targetTicks;
+        FocusBacklashStatsN[FBS_OVERSHOOT].value += 2.0 * std::fabs(static_cast<double>(targetTicks) - overshoot);
+        FocusBacklashStatsN[FBS_MOVES].value++;
+        publishBacklashStats();
+    }
+    return state;
+}
+
+// one leg of a move, sent to the firmware as is
+IPState AstroLink4micro::startFocuserLeg(uint32_t targetTicks)
 {
     char cmd[ASTROLINK4_LEN] = {0}, res[ASTROLINK4_LEN] = {0};
     snprintf(cmd, ASTROLINK4_LEN, "R:%i:%u", 0, targetTicks);
-    return (sendCommand(cmd, res)) ? IPS_BUSY : IPS_ALERT;
+    if (!sendCommand(cmd, res))
+    {
+        backlashTarget = -1;
+        return IPS_ALERT;
+    }
+    startFocuserEstimate(targetTicks);
+    FocusBacklashStatsN[FBS_TOTAL].value += std::fabs(static_cast<double>(targetTicks) - focuserPosition);
+    publishBacklashStats();
+    return IPS_BUSY;
+}
+
+void AstroLink4micro::publishBacklashStats()
+{
+    FocusBacklashStatsNP.s = IPS_OK;
+    IDSetNumber(&FocusBacklashStatsNP, nullptr);
 }
 
 IPState AstroLink4micro::MoveRelFocuser(FocusDirection dir, uint32_t ticks)
 {
-    return MoveAbsFocuser(dir == FOCUS_INWARD ? FocusAbsPosNP[0].getValue() - ticks : FocusAbsPosNP[0].getValue() + ticks);
+    // relative to the last polled position, not to an interpolated one
+    return MoveAbsFocuser(dir == FOCUS_INWARD ? std::max(focuserPosition - ticks, 0.0) : focuserPosition + ticks);
 }
 
+// H is the only hard halt of the firmware and stops both axes, a move of axis 2 ends with it
 bool AstroLink4micro::AbortFocuser()
 {
     char res[ASTROLINK4_LEN] = {0};
-    return (sendCommand("H", res));
+    focuserEstimate.active = false;
+    backlashTarget = -1;
+    if (!sendCommand("H", res))
+        return false;
+
+    if (Focuser2AbsPosNP.s == IPS_BUSY)
+    {
+        DEBUG(INDI::Logger::DBG_WARNING, "Abort halted focuser 2 as well");
+        // the next q frame reports where axis 2 stopped
+        focuser2Target = static_cast<uint32_t>(Focuser2AbsPosN[0].value);
+        traceState("FOCUS2_ABS_POSITION", IPS_IDLE);
+        Focuser2AbsPosNP.s = Focuser2RelPosNP.s = IPS_IDLE;
+        IDSetNumber(&Focuser2AbsPosNP, nullptr);
+        IDSetNumber(&Focuser2RelPosNP, nullptr);
+    }
+    return true;
 }
 
 bool AstroLink4micro::ReverseFocuser(bool enabled)
 {
-    if (updateSettings("u", "U", U_FOC1_REV, (enabled) ? "1" : "0"))
-    {
-        FocusReverseSP.setState(IPS_BUSY);
-        return true;
-    }
-    else
-    {
-        return false;
-    }
+    pendingSettings[U_FOC1_REV] = (enabled) ? "1" : "0";
+    FocusReverseSP.setState(IPS_BUSY);
+    return true;
 }
 
 bool AstroLink4micro::SyncFocuser(uint32_t ticks)
@@ -640,6 +2304,9 @@ bool AstroLink4micro::SyncFocuser(uint32_t ticks)
     snprintf(cmd, ASTROLINK4_LEN, "P:%i:%u", 0, ticks);
     if (sendCommand(cmd, res))
     {
+        // keep recorded focus points in the new position frame
+        focusModel.shift(static_cast<double>(ticks) - focuserPosition);
+        backlashTarget = -1;
         FocusAbsPosNP.setState(IPS_BUSY);
         return true;
     }
@@ -649,17 +2316,57 @@ bool AstroLink4micro::SyncFocuser(uint32_t ticks)
     }
 }
 
+// backlash is applied by the move planner on the host, the firmware has no setting for it
+bool AstroLink4micro::SetFocuserBacklash(int32_t)
+{
+    return true;
+}
+
+bool AstroLink4micro::SetFocuserBacklashEnabled(bool)
+{
+    return true;
+}
+
 bool AstroLink4micro::SetFocuserMaxPosition(uint32_t ticks)
 {
-    if (updateSettings("u", "U", U_FOC1_MAX, std::to_string(ticks).c_str()))
-    {
-        FocusMaxPosNP.setState(IPS_BUSY);
-        return true;
-    }
-    else
-    {
-        return false;
-    }
+    pendingSettings[U_FOC1_MAX] = std::to_string(ticks);
+    FocusMaxPosNP.setState(IPS_BUSY);
+    return true;
+}
+
+// axis 2 moves independently of axis 1, the firmware runs both at once
+IPState AstroLink4micro::moveFocuser2(uint32_t targetTicks)
+{
+    char cmd[ASTROLINK4_LEN] = {0}, res[ASTROLINK4_LEN] = {0};
+    if (targetTicks > Focuser2MaxPosN[0].value)
+        targetTicks = Focuser2MaxPosN[0].value;
+    snprintf(cmd, ASTROLINK4_LEN, "R:%i:%u", 1, targetTicks);
+    if (!sendCommand(cmd, res))
+        return IPS_ALERT;
+    focuser2Target = targetTicks;
+    return IPS_BUSY;
+}
+
+// the firmware halt (H) stops both axes, so axis 2 is retargeted to where it can come to rest:
+// the last reported position carried forward at full speed since that frame plus the braking
+// distance. The motor stops near, not exactly at, the moment of the request.
+IPState AstroLink4micro::stopFocuser2()
+{
+    if (Focuser2AbsPosNP.s != IPS_BUSY)
+        return IPS_OK;
+
+    double position = Focuser2AbsPosN[0].value, target = focuser2Target;
+    double speed = std::max(Focuser2SettingsN[FS1_SPEED].value, 1.0), accel = speed * 5.0;
+    double travel = speed * std::max(monotonicSeconds() - focuser2FrameTime, 0.0) + speed * speed / (2.0 * accel);
+    double stop = (target >= position) ? std::min(position + travel, target) : std::max(position - travel, target);
+
+    char cmd[ASTROLINK4_LEN] = {0}, res[ASTROLINK4_LEN] = {0};
+    snprintf(cmd, ASTROLINK4_LEN, "R:%i:%u", 1, static_cast<uint32_t>(std::lround(stop)));
+    if (!sendCommand(cmd, res))
+        return IPS_ALERT;
+    focuser2Target = static_cast<uint32_t>(std::lround(stop));
+    DEBUGF(INDI::Logger::DBG_SESSION, "Focuser 2 soft stop at %u steps", focuser2Target);
+    return IPS_OK;
 }
 
 /**************************************************************************************
@@ -673,9 +2380,20 @@ const char *AstroLink4micro::getDefaultName()
 bool AstroLink4micro::saveConfigItems(FILE *fp)
 {
 	IUSaveConfigText(fp, &RelayLabelsTP);
+	IUSaveConfigText(fp, &CaptureFileTP);
+	IUSaveConfigText(fp, &FlightRecorderDirTP);
 	IUSaveConfigNumber(fp, &PWM1NP);
 	IUSaveConfigNumber(fp, &PWM2NP);
+	IUSaveConfigSwitch(fp, &DewControlSP);
+	IUSaveConfigNumber(fp, &PowerProfileSettingsNP);
+	IUSaveConfigNumber(fp, &DewSettingsNP);
     IUSaveConfigNumber(fp, &SQMOffsetNP);
+    IUSaveConfigNumber(fp, &SQMIntegrationSettingsNP);
+    IUSaveConfigNumber(fp, &WeatherSafetyNP);
+    IUSaveConfigSwitch(fp, &FocusModelSourceSP);
+    IUSaveConfigSwitch(fp, &FocusApproachSP);
+    IUSaveConfigNumber(fp, &FocusModelSettingsNP);
+    IUSaveConfigNumber(fp, &FocusInterpolationNP);
 
 	FI::saveConfigItems(fp);
 	WI::saveConfigItems(fp);
@@ -709,3 +2427,9 @@ std::string AstroLink4micro::intToStr(double val)
     sprintf(buf, "%i", (int)val);
     return std::string(buf);
 }
+
+
+double AstroLink4micro::monotonicSeconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -30,11 +30,21 @@
 #include <cstring>
 #include <map>
 #include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <ctime>
+#include <atomic>
+#include <csignal>
 
 #include <defaultdevice.h>
 #include <indifocuserinterface.h>
 #include <indiweatherinterface.h>
 
+#include "astrolink4_capture.h"
+#include "astrolink4_stats.h"
+#include "astrolink4_trace.h"
+
 
 #define Q_DEVICE_CODE 0
 #define Q_FOC1_POS 1
@@ -140,15 +150,14 @@ class AstroLink4micro : public INDI::DefaultDevice, public INDI::FocuserInterfac
         virtual bool AbortFocuser();
         virtual bool SyncFocuser(uint32_t ticks) override;
         virtual bool SetFocuserMaxPosition(uint32_t ticks) override;
+        virtual bool SetFocuserBacklash(int32_t steps) override;
+        virtual bool SetFocuserBacklashEnabled(bool enabled) override;
       
         virtual void TimerHit();
         virtual bool saveConfigItems(FILE *fp);
         
         // Weather Overrides
-        virtual IPState updateWeather() override
-        {
-            return IPS_OK;
-        }        
+        virtual IPState updateWeather() override;
         
     private:
         int PortFD { -1 };
@@ -156,13 +165,176 @@ class AstroLink4micro : public INDI::DefaultDevice, public INDI::FocuserInterfac
         char stopChar { 0xA };
         bool Handshake();
         virtual bool sendCommand(const char *cmd, char *res);
+        void discardLateReply(double timeout);
+        int commandClass(char command);
+        uint32_t pollPeriod();
+        void updateProtection(int type, double value, double vin, double itot);
+        void publishProtectionLog();
+        void traceState(const char *name, IPState state);
+        bool dumpFlightRecorder(const char *reason);
+        static void flightRecorderSignalHandler(int signal);
+        void recordFocusPoint();
+        void applyFocusModel();
+        void publishFocusModel();
+        IPState startFocuserLeg(uint32_t targetTicks);
+        void publishBacklashStats();
+        void startFocuserEstimate(uint32_t targetTicks);
+        double estimateFocuserPosition(double now, double *velocity);
+        void correctFocuserEstimate(int position, bool moving);
+        void publishInterpolatedPosition();
+        void startInterpolationTimer();
+        static void interpolationTimerHelper(void *context);
+        void updateSerialDiagnostics();
         bool readDevice();
         
         std::vector<std::string> split(const std::string &input, const std::string &regex);
         bool updateSettings(const char *getCom, const char *setCom, int index, const char *value);
         bool updateSettings(const char *getCom, const char *setCom, std::map<int, std::string> values);   
+        bool flushSettings();
+        int settingsGroup(int index);
+        bool readbackPending(int group, IPState state);
+        IPState readbackState(int group);
+        void queueFocuserSettings(int axis, const double values[]);
+        void readFocuserSettings(int axis, const std::vector<std::string> &result, INumber *settings);
+        IPState moveFocuser2(uint32_t targetTicks);
+        IPState stopFocuser2();
         std::string doubleToStr(double val);
         std::string intToStr(double val);
+        double monotonicSeconds();
+        void updateWeatherSafety();
+        void updateSensorPresence(int sensor, bool present);
+        INumber *ambientSensor();
+        void defineWeatherParameters();
+        bool modelTemperature(double &temperature);
+        void updateDewControl(double now);
+        bool setHeaterDuty(int channel, int duty);
+        void noteOutputChange(int output, double change);
+        void updatePowerProfile(double now, double vin, double itot);
+        void publishPowerProfile();
+
+        RollingStats skyDiffStats, humidityStats, dewMarginStats, sqmStats;
+        bool cloudAlert { false }, dewAlert { false };
+        double lastWeatherSample { 0 };
+
+        void publishSQM(bool force);
+        AdaptiveAverager sqmAverager;
+
+        // round trip estimates per command class, reads use a lower floor as they can be retried
+        enum
+        {
+            CMD_QUERY, CMD_SETTINGS_READ, CMD_SETTINGS_WRITE, CMD_MOTION, CMD_OUTPUT, CMD_OTHER, CMD_N
+        };
+        RttEstimator rttEstimators[CMD_N] =
+        {
+            RttEstimator(0.05, 3.0), RttEstimator(0.05, 3.0), RttEstimator(0.5, 3.0),
+            RttEstimator(0.5, 3.0), RttEstimator(0.5, 3.0), RttEstimator(0.05, 3.0)
+        };
+        unsigned long serialTimeouts { 0 }, serialRetries { 0 };
+        int diagnosticsCounter { 0 };
+
+        // protection trips, kept until the driver is restarted
+        struct ProtectionEvent
+        {
+            time_t time;
+            int type;
+            double value;
+            double vin;
+            double itot;
+        };
+        std::deque<ProtectionEvent> protectionEvents;
+        int protectionType { 0 };
+        RollingStats vinStats { 10 };
+        double fastPollUntil { 0 };
+
+        // temperature vs focus position model, fed by the client after each autofocus run
+        LinearRls focusModel { 0.98 };
+
+        // sensor properties are defined only while the sensor reports present
+        enum
+        {
+            SENSOR_1, SENSOR_2, SENSOR_EXT, SENSOR_SKY, SENSOR_SQM, SENSOR_N
+        };
+        INumberVectorProperty *sensorProperties[SENSOR_N] { nullptr };
+        bool sensorDefined[SENSOR_N] { false };
+
+        // weather parameters are added from the presence flags of the first q frame,
+        // the WeatherInterface cannot remove a parameter once it is added
+        enum
+        {
+            WP_AMBIENT, WP_SKY, WP_SQM, WP_N
+        };
+        bool weatherParameters[WP_N] { false };
+        bool weatherDefined { false };
+        // the sensor of the group was seen in this connection, only then is its loss an alert
+        bool weatherMonitored[WP_N] { false };
+
+        // dead reckoning of the focuser between q frames, anchored at the last real position
+        struct FocuserEstimate
+        {
+            bool active;
+            double time;
+            double position;
+            double velocity;
+            double target;
+        };
+        FocuserEstimate focuserEstimate { false, 0, 0, 0, 0 };
+        double focuserPosition { 0 };
+
+        // host side dew heater control, one PI loop per PWM channel
+        double dewIntegral[2] { 0, 0 };
+        double lastDewControl { 0 }, lastHeaterSample { 0 };
+
+        // power profiling, load per output is learned from the current step after a change
+        enum
+        {
+            OUTPUT_OUT1, OUTPUT_OUT2, OUTPUT_OUT3, OUTPUT_PWM1, OUTPUT_PWM2, OUTPUT_N
+        };
+        struct LoadStep
+        {
+            bool active;
+            int output;
+            double change;
+            double baseline;
+            double start;
+            double sum;
+            int samples;
+            double peak;
+        };
+        LoadStep loadStep { false, 0, 0, 0, 0, 0, 0, 0 };
+        int loadSamples[OUTPUT_N] { 0 };
+        RollingStats currentStats { 2 }, runtimeStats { 60 };
+        double profileBurstUntil { 0 }, profileStart { 0 }, lastProfilePublish { 0 };
+        double lastPowerSample { 0 }, lastVin { 0 }, lastItot { 0 };
+
+        // axis 2 has no halt of its own, a soft stop retargets it from the last frame
+        uint32_t focuser2Target { 0 };
+        double focuser2FrameTime { 0 };
+
+        // final target of a backlash move while its overshoot leg runs, -1 = none
+        int64_t backlashTarget { -1 };
+        // the final leg could not be started, the focuser rests at the overshoot until the next move
+        bool backlashLegFailed { false };
+        double estimateErrorMean { 0 }, estimateErrorMax { 0 };
+        unsigned long estimateSamples { 0 };
+        int interpolationTimerID { -1 };
+
+        // always-on trace of serial traffic and state changes, dumped on error, signal or request
+        FlightRecorder flightRecorder;
+        bool flightRecorderErrorPending { false };
+        // one error dump per episode of failing polls, re-armed by a clean poll
+        bool flightRecorderErrorArmed { true };
+        double lastFlightRecorderDump { -1e9 };
+        static std::atomic<bool> flightRecorderSignalPending;
+
+        // settings changes are collected here and written in one U command per poll
+        std::map<int, std::string> pendingSettings;
+        // properties covered by a failed settings write, reported as alert after the readback
+        enum
+        {
+            SG_FOCUSER1, SG_FOCUSER2, SG_MODE1, SG_MODE2, SG_MAX1, SG_MAX2, SG_REVERSE1, SG_REVERSE2,
+            SG_PROTECTION, SG_DEW_AUTOMATION, SG_N
+        };
+        bool failedSettings[SG_N] { false };
              
         
         INumber Focuser1SettingsN[6];
@@ -177,8 +349,173 @@ class AstroLink4micro : public INDI::DefaultDevice, public INDI::FocuserInterfac
             FS1_COMP_THRESHOLD
         };        
         
+        INumber WeatherSafetyN[7];
+        INumberVectorProperty WeatherSafetyNP;
+        enum
+        {
+            WS_WINDOW,
+            WS_CLOUD_LIMIT,
+            WS_CLOUD_VARIATION,
+            WS_CLOUD_HYST,
+            WS_DEW_LIMIT,
+            WS_DEW_HYST,
+            WS_HUM_LIMIT
+        };
+
+        INumber WeatherStatsN[12];
+        INumberVectorProperty WeatherStatsNP;
+        enum
+        {
+            WST_SKY_MEAN,
+            WST_SKY_STDDEV,
+            WST_SKY_TREND,
+            WST_SKY_MIN,
+            WST_SKY_MAX,
+            WST_HUM_MEAN,
+            WST_HUM_TREND,
+            WST_DEW_MEAN,
+            WST_DEW_MIN,
+            WST_DEW_TREND,
+            WST_SQM_MEAN,
+            WST_SQM_STDDEV
+        };
+
+        // Second focuser axis, settings share the FS1_* and FS1_MODE_* layout
+        INumber Focuser2AbsPosN[1];
+        INumberVectorProperty Focuser2AbsPosNP;
+        INumber Focuser2RelPosN[1];
+        INumberVectorProperty Focuser2RelPosNP;
+        ISwitch Focuser2MotionS[2];
+        ISwitchVectorProperty Focuser2MotionSP;
+        enum
+        {
+            F2_INWARD, F2_OUTWARD
+        };
+        ISwitch Focuser2AbortS[1];
+        ISwitchVectorProperty Focuser2AbortSP;
+        INumber Focuser2SyncN[1];
+        INumberVectorProperty Focuser2SyncNP;
+        INumber Focuser2MaxPosN[1];
+        INumberVectorProperty Focuser2MaxPosNP;
+        ISwitch Focuser2ReverseS[2];
+        ISwitchVectorProperty Focuser2ReverseSP;
+        enum
+        {
+            F2_REVERSE_ENABLED, F2_REVERSE_DISABLED
+        };
+        INumber Focuser2SettingsN[6];
+        INumberVectorProperty Focuser2SettingsNP;
+        ISwitch Focuser2ModeS[3];
+        ISwitchVectorProperty Focuser2ModeSP;
+
+        ISwitch FocusModelS[3];
+        ISwitchVectorProperty FocusModelSP;
+        enum
+        {
+            FM_RECORD, FM_APPLY, FM_RESET
+        };
+        ISwitch FocusModelSourceS[2];
+        ISwitchVectorProperty FocusModelSourceSP;
+        enum
+        {
+            FMSRC_SENSOR1, FMSRC_SENSOR2
+        };
+        INumber FocusModelSettingsN[2];
+        INumberVectorProperty FocusModelSettingsNP;
+        enum
+        {
+            FMSET_FORGETTING, FMSET_AUTO_CI
+        };
+        INumber FocusModelN[5];
+        INumberVectorProperty FocusModelNP;
+        enum
+        {
+            FMD_SLOPE, FMD_CI, FMD_POINTS, FMD_RESIDUAL, FMD_PREDICTED
+        };
+
+        INumber FocusInterpolationN[1];
+        INumberVectorProperty FocusInterpolationNP;
+        INumber FocusEstimateN[4];
+        INumberVectorProperty FocusEstimateNP;
+        enum
+        {
+            FE_LAST, FE_MEAN, FE_MAX, FE_SAMPLES
+        };
+
+        ISwitch FocusApproachS[2];
+        ISwitchVectorProperty FocusApproachSP;
+        enum
+        {
+            APPROACH_OUTWARD, APPROACH_INWARD
+        };
+
+        INumber FocusBacklashStatsN[3];
+        INumberVectorProperty FocusBacklashStatsNP;
+        enum
+        {
+            FBS_TOTAL, FBS_OVERSHOOT, FBS_MOVES
+        };
+
         INumber SQMOffsetN[1];
         INumberVectorProperty SQMOffsetNP;
+
+        IText FlightRecorderDirT[1];
+        ITextVectorProperty FlightRecorderDirTP;
+        ISwitch FlightRecorderDumpS[1];
+        ISwitchVectorProperty FlightRecorderDumpSP;
+
+        INumber SerialDiagN[12];
+        INumberVectorProperty SerialDiagNP;
+        enum
+        {
+            SD_QUERY_RTT, SD_QUERY_RTO,
+            SD_READ_RTT, SD_READ_RTO,
+            SD_WRITE_RTT, SD_WRITE_RTO,
+            SD_MOTION_RTT, SD_MOTION_RTO,
+            SD_OUTPUT_RTT, SD_OUTPUT_RTO,
+            SD_TIMEOUTS, SD_RETRIES
+        };
+
+        INumber Sensor1N[3];
+        INumberVectorProperty Sensor1NP;
+        INumber Sensor2N[1];
+        INumberVectorProperty Sensor2NP;
+        INumber SensorExtN[3];
+        INumberVectorProperty SensorExtNP;
+        enum
+        {
+            SENS_TEMP,
+            SENS_HUM,
+            SENS_DEW
+        };
+
+        INumber SkySensorN[3];
+        INumberVectorProperty SkySensorNP;
+        enum
+        {
+            SKY_TEMP,
+            SKY_AMBIENT,
+            SKY_DIFF
+        };
+
+        INumber SQMIntegrationN[4];
+        INumberVectorProperty SQMIntegrationNP;
+        enum
+        {
+            SQMI_VALUE,
+            SQMI_UNCERTAINTY,
+            SQMI_SAMPLES,
+            SQMI_NOISE
+        };
+
+        INumber SQMIntegrationSettingsN[3];
+        INumberVectorProperty SQMIntegrationSettingsNP;
+        enum
+        {
+            SQMS_TARGET,
+            SQMS_MAX_SAMPLES,
+            SQMS_NOISE_FLOOR
+        };
         
         ISwitch Focuser1ModeS[3];
         ISwitchVectorProperty Focuser1ModeSP;
@@ -199,6 +536,21 @@ class AstroLink4micro : public INDI::DefaultDevice, public INDI::FocuserInterfac
             POW_WH
         };        
         
+        ILight ProtectionL[2];
+        ILightVectorProperty ProtectionLP;
+        enum
+        {
+            PROT_OVERVOLTAGE, PROT_OVERCURRENT
+        };
+        IText ProtectionLogT[5];
+        ITextVectorProperty ProtectionLogTP;
+        INumber ProtectionSettingsN[3];
+        INumberVectorProperty ProtectionSettingsNP;
+        enum
+        {
+            PS_OVERVOLTAGE, PS_OVERCURRENT, PS_OVERTIME
+        };
+
         IText RelayLabelsT[5];
         ITextVectorProperty RelayLabelsTP;
         enum
@@ -225,15 +577,84 @@ class AstroLink4micro : public INDI::DefaultDevice, public INDI::FocuserInterfac
             S3_ON,S3_OFF
         };
 
+        ISwitch PowerProfileS[2];
+        ISwitchVectorProperty PowerProfileSP;
+        enum
+        {
+            PP_ON, PP_OFF
+        };
+
+        INumber PowerProfileSettingsN[3];
+        INumberVectorProperty PowerProfileSettingsNP;
+        enum
+        {
+            PPS_BURST, PPS_CAPACITY, PPS_RESERVE
+        };
+
+        INumber PowerProfileN[6];
+        INumberVectorProperty PowerProfileNP;
+        enum
+        {
+            PPD_DURATION, PPD_ENERGY, PPD_CHARGE, PPD_POWER, PPD_PEAK, PPD_RUNTIME
+        };
+
+        INumber PowerLoadN[10];
+        INumberVectorProperty PowerLoadNP;
+        enum
+        {
+            LOAD_OUT1, LOAD_OUT2, LOAD_OUT3, LOAD_PWM1, LOAD_PWM2,
+            INRUSH_OUT1, INRUSH_OUT2, INRUSH_OUT3, INRUSH_PWM1, INRUSH_PWM2
+        };
+
         INumber PWM1N[1];
         INumberVectorProperty PWM1NP;
         INumber PWM2N[1];
         INumberVectorProperty PWM2NP;
+
+        ISwitch DewControlS[2];
+        ISwitchVectorProperty DewControlSP;
+        enum
+        {
+            DEW_PWM1, DEW_PWM2
+        };
+
+        INumber DewSettingsN[7];
+        INumberVectorProperty DewSettingsNP;
+        enum
+        {
+            DS_MARGIN, DS_KP, DS_KI, DS_DEADBAND, DS_MAX, DS_POWER1, DS_POWER2
+        };
+
+        INumber DewStateN[7];
+        INumberVectorProperty DewStateNP;
+        enum
+        {
+            DST_TARGET, DST_TEMP, DST_ERROR, DST_DUTY1, DST_DUTY2, DST_ENERGY1, DST_ENERGY2
+        };
+
+        INumber DewAutomationN[2];
+        INumberVectorProperty DewAutomationNP;
+        enum
+        {
+            DA_START, DA_FULL
+        };
+
+        IText CaptureFileT[1];
+        ITextVectorProperty CaptureFileTP;
+        ISwitch SerialCaptureS[2];
+        ISwitchVectorProperty SerialCaptureSP;
+        enum
+        {
+            CAP_ON, CAP_OFF
+        };
+        CaptureWriter captureWriter;
    
         
         static constexpr const char *SETTINGS_TAB{"Settings"};
+        static constexpr const char *FOCUSER2_TAB{"Focuser 2"};
         static constexpr const char *POWER_TAB{"Power"};
-        static constexpr const char *ENVIRONMENT_TAB{"Environment"};        
+        static constexpr const char *ENVIRONMENT_TAB{"Environment"};
+        static constexpr const char *DIAGNOSTICS_TAB{"Diagnostics"};        
         
 };
 